@@ -0,0 +1,604 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "cache-journal.hh"
+
+#include "config.hh"
+#include "master.hh"
+#include "script-tools.hh"
+#include "script-travelers.hh"
+#include "utils/path.hh"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+struct CacheJournal::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+};
+
+//
+
+namespace
+{
+    const char Magic[8] = { 's', 'w', 'd', 'j', 'r', 'n', 'l', '\n' };
+
+    enum : uint32_t {
+        Version   = 2,
+        ByteOrder = 0x01020304,
+    };
+
+    enum { RecordHeaderSize = 8 };          // length, checksum
+
+    const std::chrono::seconds SyncInterval(1);
+
+    //
+
+    int64_t monotonicNow()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint32_t checksum(const uint8_t* data, std::size_t size)
+    {
+        // FNV-1a
+
+        uint32_t hash = 2166136261u;
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash ^= data[i];
+            hash *= 16777619u;
+        }
+
+        return hash;
+    }
+
+    void putUint32(std::string& out, uint32_t value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    uint32_t getUint32(const uint8_t* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void writeAll(int fd, const char* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = write(fd, data, size);
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw std::runtime_error("failed to write cache journal " + CacheJournal::fileName() + ": " + strerror(errno));
+            }
+
+            data += written;
+            size -= written;
+        }
+    }
+
+    // fields of one record
+
+    class RecordReader {
+    public:
+        RecordReader(const uint8_t* data, std::size_t size)
+            : m_data(data),
+              m_end(data + size) {}
+
+        bool next(std::string& field)
+        {
+            if (m_end - m_data < 4) {
+                return false;
+            }
+
+            const uint32_t length = getUint32(m_data);
+            m_data += 4;
+
+            if (uint64_t(m_end - m_data) < length) {
+                return false;
+            }
+
+            field.assign(reinterpret_cast<const char*>(m_data), length);
+            m_data += length;
+
+            return true;
+        }
+
+    private:
+        const uint8_t* m_data;
+        const uint8_t* m_end;
+    };
+
+    //
+
+    // units and artifacts that records refer to, with their saved state
+    // loaded before the records are applied over it
+
+    Step* findStep(Master& master, const std::string& name)
+    {
+        Step* found = nullptr;
+
+        master.root->apply(travelers::FindUnit(name,
+                                               lambdaVisitor([&found] (Step& step) { found = &step; })));
+
+        if (found) {
+            master.loadUnitCache(*found->parent());
+        }
+
+        return found;
+    }
+
+    Script* findScript(Master& master, const std::string& name)
+    {
+        Script* found = nullptr;
+
+        master.root->apply(travelers::FindUnit(name,
+                                               lambdaVisitor([&found] (Script& script) { found = &script; })));
+
+        if (found) {
+            master.loadUnitCache(*found);
+        }
+
+        return found;
+    }
+
+    class find_scope : public Unit::Visitor {
+    public:
+        find_scope(Unit*& found)
+            : m_found(found) {}
+
+        void operator() (Group& group) const override { m_found = &group; }
+        void operator() (Script& script) const override { m_found = &script; }
+
+    private:
+        Unit*& m_found;
+    };
+
+    Artifact* findArtifact(Master& master, const std::string& name)
+    {
+        const auto iter = master.artifacts.find(name);
+
+        if (iter == master.artifacts.end()) {
+            return nullptr;
+        }
+
+        Unit* scope = nullptr;
+
+        master.root->apply(travelers::FindUnit(iter->second->scope(),
+                                               find_scope(scope)));
+
+        if (scope) {
+            master.loadUnitCache(*scope);
+        }
+
+        return iter->second.get();
+    }
+}
+
+// ------------------------------------------------------------
+
+void CacheJournal::stepCompleted(Step& step)
+{
+    if (!recording()) {
+        return;
+    }
+
+    begin(Type::StepCompleted);
+    add(tools::conjurePath(step));
+    commit();
+}
+
+void CacheJournal::stepUndone(Step& step)
+{
+    if (!recording()) {
+        return;
+    }
+
+    begin(Type::StepUndone);
+    add(tools::conjurePath(step));
+    commit();
+}
+
+void CacheJournal::scriptUndone(Script& script)
+{
+    if (!recording()) {
+        return;
+    }
+
+    begin(Type::ScriptUndone);
+    add(tools::conjurePath(script));
+    commit();
+}
+
+void CacheJournal::dependencyStored(const std::string& stepName,
+                                    const Dependency& dependency)
+{
+    if (!recording()) {
+        return;
+    }
+
+    begin(Type::DependencyStored);
+    add(stepName);
+    add(dependency.type());
+    add(dependency.id());
+    add(dependency.getHashSum());
+    commit();
+}
+
+void CacheJournal::artifactStored(const Artifact& artifact)
+{
+    if (!recording()) {
+        return;
+    }
+
+    begin(Type::ArtifactStored);
+    add(artifact.name());
+    add(artifact.getHashSum());
+    commit();
+}
+
+void CacheJournal::artifactMarked(const std::string& artifactName,
+                                  const std::string& stepName,
+                                  Artifact::Link::Type type)
+{
+    if (!recording()) {
+        return;
+    }
+
+    begin(Type::ArtifactMarked);
+    add(artifactName);
+    add(stepName);
+    add(Artifact::Link::typeToString(type));
+    commit();
+}
+
+void CacheJournal::artifactUnmarked(const std::string& artifactName,
+                                    const std::string& stepName)
+{
+    if (!recording()) {
+        return;
+    }
+
+    begin(Type::ArtifactUnmarked);
+    add(artifactName);
+    add(stepName);
+    commit();
+}
+
+void CacheJournal::replay(Master& master)
+{
+    const utils::OpenFile file(fileName(), O_RDONLY);
+
+    if (!file.isOpen()) {
+        return;
+    }
+
+    std::string contents;
+
+    utils::readAll(file.fd(),
+                   [&contents] (const uint8_t* data, std::size_t size)
+                   {
+                       contents.append(reinterpret_cast<const char*>(data), size);
+                   });
+
+    Header header;
+
+    if (contents.size() < sizeof(Header)) {
+        unlink(fileName().c_str());
+        return;
+    }
+
+    std::memcpy(&header, contents.data(), sizeof(Header));
+
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+        || header.version != Version
+        || header.byteOrder != ByteOrder)
+    {
+        std::cerr << "Discarding unknown cache journal." << std::endl;
+        unlink(fileName().c_str());
+        return;
+    }
+
+    //
+
+    const uint8_t* const data = reinterpret_cast<const uint8_t*>(contents.data());
+    std::size_t offset = sizeof(Header);
+    std::size_t applied = 0;
+
+    std::string fields[4];
+
+    while (contents.size() - offset >= RecordHeaderSize)
+    {
+        const uint32_t length = getUint32(data + offset);
+        const uint32_t sum    = getUint32(data + offset + 4);
+
+        if (length == 0
+            || contents.size() - offset - RecordHeaderSize < length
+            || checksum(data + offset + RecordHeaderSize, length) != sum)
+        {
+            break;                  // torn write, the rest is lost
+        }
+
+        const uint8_t* record = data + offset + RecordHeaderSize;
+        offset += RecordHeaderSize + length;
+
+        RecordReader reader(record + 1, length - 1);
+        unsigned int count = 0;
+
+        while (count < 4
+               && reader.next(fields[count]))
+        {
+            ++count;
+        }
+
+        // the scripts may have changed since: records about units and
+        // artifacts that no longer exist are skipped
+
+        try {
+            switch (static_cast<Type>(record[0])) {
+            case Type::StepCompleted:
+                if (count == 1)
+                {
+                    if (Step* step = findStep(master, fields[0])) {
+                        step->complete();
+                    }
+                }
+                break;
+
+            case Type::StepUndone:
+                if (count == 1)
+                {
+                    if (Step* step = findStep(master, fields[0])) {
+                        step->undo();
+                    }
+                }
+                break;
+
+            case Type::ScriptUndone:
+                if (count == 1)
+                {
+                    if (Script* script = findScript(master, fields[0])) {
+                        script->undoAllSteps();
+                    }
+                }
+                break;
+
+            case Type::DependencyStored:
+                if (count == 4)
+                {
+                    if (Step* step = findStep(master, fields[0]))
+                    {
+                        step->forEachDependency(
+                            [&fields] (Dependency& dependency)
+                            {
+                                if (dependency.type() == fields[1]
+                                    && dependency.id() == fields[2])
+                                {
+                                    dependency.storeHash(fields[3]);
+                                }
+                            });
+
+                        step->parent()->setCacheDirty();
+                    }
+                }
+                break;
+
+            case Type::ArtifactStored:
+                if (count == 2)
+                {
+                    if (Artifact* artifact = findArtifact(master, fields[0]))
+                    {
+                        artifact->storeHash(fields[1]);
+                        artifact->setCacheDirty();
+                    }
+                }
+                break;
+
+            case Type::ArtifactMarked:
+                if (count == 3)
+                {
+                    if (Artifact* artifact = findArtifact(master, fields[0]))
+                    {
+                        artifact->restoreMark(fields[1],
+                                              Artifact::Link::parse(fields[2]));
+                        artifact->setCacheDirty();
+                    }
+                }
+                break;
+
+            case Type::ArtifactUnmarked:
+                if (count == 2)
+                {
+                    if (Artifact* artifact = findArtifact(master, fields[0])) {
+                        artifact->dropMark(fields[1]);
+                    }
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+        catch (std::exception&) {
+        }
+
+        ++applied;
+    }
+
+    m_validSize = offset;
+
+    if (applied > 0) {
+        std::cerr << "Replayed " << applied << " cache journal record(s)." << std::endl;
+    }
+}
+
+void CacheJournal::start()
+{
+    m_started = true;
+}
+
+void CacheJournal::discard()
+{
+    if (!m_started) {
+        return;                 // not replayed, still needed
+    }
+
+    close();
+
+    m_started = false;
+    m_validSize = 0;
+
+    unlink(fileName().c_str());
+}
+
+void CacheJournal::sync()
+{
+    if (m_fd >= 0
+        && m_unsynced)
+    {
+        fdatasync(m_fd);
+
+        m_lastSync = monotonicNow();
+        m_unsynced = false;
+    }
+}
+
+std::string CacheJournal::fileName()
+{
+    return Config::instance().cache_dir + "/cache.journal";
+}
+
+CacheJournal& CacheJournal::instance()
+{
+    static CacheJournal s_journal;
+    return s_journal;
+}
+
+// ------------------------------------------------------------
+
+void CacheJournal::begin(Type type)
+{
+    m_record.assign(RecordHeaderSize, '\0');
+    m_record += static_cast<char>(type);
+}
+
+void CacheJournal::add(const std::string& field)
+{
+    putUint32(m_record, field.size());
+    m_record += field;
+}
+
+void CacheJournal::commit()
+{
+    const uint32_t length = m_record.size() - RecordHeaderSize;
+    const uint32_t sum    = checksum(reinterpret_cast<const uint8_t*>(m_record.data()) + RecordHeaderSize, length);
+
+    std::memcpy(&m_record[0], &length, sizeof(length));
+    std::memcpy(&m_record[4], &sum, sizeof(sum));
+
+    if (m_fd < 0) {
+        open();
+    }
+
+    // written right away, so the record survives the process; synced in
+    // batches, as that is what survives the machine
+
+    writeAll(m_fd, m_record.data(), m_record.size());
+    m_unsynced = true;
+
+    if (monotonicNow() - m_lastSync >= std::chrono::nanoseconds(SyncInterval).count()) {
+        sync();
+    }
+}
+
+void CacheJournal::open()
+{
+    utils::safeMkdir(Config::instance().cache_dir);
+
+    const std::string name = fileName();
+
+    if (m_validSize > 0)
+    {
+        // continue the replayed journal, minus its torn tail
+
+        m_fd = ::open(name.c_str(), O_WRONLY | O_CLOEXEC);
+
+        if (m_fd >= 0
+            && ftruncate(m_fd, m_validSize) == 0
+            && lseek(m_fd, 0, SEEK_END) >= 0)
+        {
+            return;
+        }
+
+        close();
+    }
+
+    m_fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (m_fd < 0) {
+        throw std::runtime_error("failed to open cache journal " + name + ": " + strerror(errno));
+    }
+
+    Header header;
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.byteOrder = ByteOrder;
+
+    writeAll(m_fd, reinterpret_cast<const char*>(&header), sizeof(header));
+
+    m_validSize = sizeof(header);
+}
+
+void CacheJournal::close()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_unsynced = false;
+}
+
+CacheJournal::Pause::Pause()
+{
+    ++instance().m_paused;
+}
+
+CacheJournal::Pause::~Pause()
+{
+    --instance().m_paused;
+}
+
+// -----
+
+CacheJournal::CacheJournal() = default;
+
+CacheJournal::~CacheJournal()
+{
+    close();
+}
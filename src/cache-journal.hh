@@ -0,0 +1,118 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include "hash-cache.hh"
+#include "hash-digest.hh"
+
+#include <cstdint>
+#include <string>
+
+// forward declarations
+
+struct Master;
+class Script;
+class Step;
+
+//
+
+// Changes made since the shards were saved, appended to
+// cache_dir/cache.journal as they happen so that a killed or crashed run
+// loses nothing it has already done:
+//
+//     header   magic, version
+//     records  [length][checksum][type][strings...], one per change
+//
+// Every record is written to the file right away and the file is synced at
+// most once a SyncInterval, so a step costs a few small writes. The end of
+// a burst is synced by sync(), called before a step is run or asked about,
+// instead of waiting for a next record while a step or the user takes its
+// time. The journal is replayed when the saved state is first loaded,
+// loading the shards it refers to; a torn or damaged record ends the
+// replay. Saving the shards removes the journal.
+//
+// Records set state rather than change it, so replaying a journal over
+// shards that already include it (the run died between the two) is
+// harmless.
+//
+// Nothing is recorded before start() or while a Pause is alive, so loading
+// saved state does not journal itself.
+
+class CacheJournal {
+public:
+    struct Pause {
+        Pause();
+        ~Pause();
+    };
+
+    //
+
+    void stepCompleted(Step& step);
+    void stepUndone(Step& step);
+    void scriptUndone(Script& script);
+    void dependencyStored(const std::string& stepName,
+                          const Dependency& dependency);
+    void artifactStored(const Artifact& artifact);
+    void artifactMarked(const std::string& artifactName,
+                        const std::string& stepName,
+                        Artifact::Link::Type type);
+    void artifactUnmarked(const std::string& artifactName,
+                          const std::string& stepName);
+
+    // replay() before start(); discard() once the shards have been saved
+
+    void replay(Master& master);
+    void start();
+    void discard();
+
+    // records written since the last sync, if any, to disk
+
+    void sync();
+
+    //
+
+    static std::string fileName();
+
+    static CacheJournal& instance();
+
+private:
+    enum class Type : uint8_t {
+        StepCompleted = 1,
+        StepUndone,
+        ScriptUndone,
+        DependencyStored,
+        ArtifactStored,
+        ArtifactMarked,
+        ArtifactUnmarked,
+    };
+
+    struct Header;
+
+    int m_fd = -1;
+    bool m_started = false;
+    unsigned int m_paused = 0;
+    uint64_t m_validSize = 0;       // of an existing journal, as replayed
+    int64_t m_lastSync = 0;
+    bool m_unsynced = false;
+    std::string m_record;
+
+    //
+
+    bool recording() const { return m_started && m_paused == 0; }
+
+    void begin(Type type);
+    void add(const std::string& field);
+    void commit();
+
+    void open();
+    void close();
+
+    CacheJournal();
+    ~CacheJournal();
+
+    CacheJournal(const CacheJournal&) = delete;
+};
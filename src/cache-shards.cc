@@ -0,0 +1,433 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "cache-shards.hh"
+
+#include "cache-journal.hh"
+#include "cache-snapshot.hh"
+#include "config.hh"
+#include "master.hh"
+#include "script-tools.hh"
+#include "script-travelers.hh"
+#include "utils/path.hh"
+
+#include "json/single_include/nlohmann/json.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <ostream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+//
+
+namespace
+{
+    const std::string ShardExt = ".snap";
+
+    bool isDirectory(const std::string& path)
+    {
+        struct stat st;
+
+        return stat(path.c_str(), &st) == 0
+            && S_ISDIR(st.st_mode);
+    }
+
+    void findShards(const std::string& path, std::vector<std::string>& shards)
+    {
+        utils::OpenDir dir(path);
+
+        while (struct dirent* entry = dir.readdir())
+        {
+            const std::string name = entry->d_name;
+
+            if (name == "." || name == "..") {
+                continue;
+            }
+
+            const std::string entryPath = path + '/' + name;
+
+            if (isDirectory(entryPath)) {
+                findShards(entryPath, shards);
+            }
+            else if (name.size() > ShardExt.size()
+                     && name.compare(name.size() - ShardExt.size(), ShardExt.size(), ShardExt) == 0)
+            {
+                shards.push_back(entryPath);
+            }
+        }
+    }
+
+    void restoreArtifact(Artifact& artifact, const CacheSnapshot& snapshot)
+    {
+        hashing::Digest hash;
+        std::vector<Artifact::Link> marks;
+
+        if (!snapshot.findArtifact(artifact.name(), hash, marks)) {
+            return;
+        }
+
+        artifact.storeHash(hash);
+
+        for (const auto& mark : marks) {
+            artifact.restoreMark(mark.name, mark.type);
+        }
+    }
+
+    void exportSnapshot(const CacheSnapshot& snapshot, json& j)
+    {
+        for (const auto& name : snapshot.artifactNames())
+        {
+            hashing::Digest hash;
+            std::vector<Artifact::Link> marks;
+
+            snapshot.findArtifact(name, hash, marks);
+
+            json& j_art = j["artifacts"][name];
+
+            j_art["hash"] = hash.str();
+
+            for (const auto& mark : marks) {
+                j_art["marks"][mark.name] = Artifact::Link::typeToString(mark.type);
+            }
+        }
+
+        for (const auto& name : snapshot.stepNames())
+        {
+            bool completed;
+            std::vector<CacheSnapshot::SavedDependency> dependencies;
+
+            snapshot.findStep(name, completed, dependencies);
+
+            json& j_step = j["steps"][name];
+
+            if (completed) {
+                j_step["completed"] = true;
+            }
+
+            for (const auto& dep : dependencies)
+            {
+                j_step["dependencies"].push_back(json{ { "hash", dep.hash.str() },
+                                                       { "id",   dep.id         },
+                                                       { "type", dep.type       } });
+            }
+        }
+    }
+}
+
+// ------------------------------------------------------------
+
+CacheShards::CacheShards(Master& master)
+    : m_master(master)
+{
+    m_master.root->apply(travelers::ForEach(lambdaVisitor([this] (Group&) { ++m_unitCount; })));
+    m_master.root->apply(travelers::ForEach(lambdaVisitor([this] (Script&) { ++m_unitCount; })));
+}
+
+CacheShards::~CacheShards() = default;
+
+void CacheShards::indexArtifacts()
+{
+    m_scopes.clear();
+
+    for (auto& artPair : m_master.artifacts)
+    {
+        m_scopes.emplace(artPair.second->scope(),
+                         artPair.second.get());
+    }
+}
+
+bool CacheShards::needsMigration() const
+{
+    return !m_checked
+        && !isDirectory(directory())
+        && (access(CacheSnapshot::legacyFileName().c_str(), F_OK) == 0
+            || access(CacheSnapshot::legacyArtifactsFileName().c_str(), F_OK) == 0
+            || access(CacheSnapshot::legacyStepsFileName().c_str(), F_OK) == 0);
+}
+
+void CacheShards::loadUnit(Unit& unit)
+{
+    if (!m_checked)
+    {
+        const bool migrating = needsMigration();
+
+        m_checked = true;
+
+        if (migrating) {
+            migrate();
+        }
+    }
+
+    if (m_migrated                          // everything is loaded
+        || !m_loaded.insert(&unit).second)
+    {
+        return;
+    }
+
+    restoreUnit(unit);
+}
+
+void CacheShards::reloadUnit(Unit& unit)
+{
+    m_loaded.insert(&unit);
+    restoreUnit(unit);
+}
+
+void CacheShards::restoreUnit(Unit& unit)
+{
+    const std::string unitPath = tools::conjurePath(unit);
+    const CacheSnapshot snapshot(fileName(unitPath));
+
+    if (!snapshot.isOpen()) {
+        return;
+    }
+
+    const CacheJournal::Pause pause;
+
+    const auto scope = m_scopes.equal_range(unitPath);
+
+    for (auto iter = scope.first; iter != scope.second; ++iter)
+    {
+        restoreArtifact(*iter->second, snapshot);
+        iter->second->setCacheDirty(false);
+    }
+
+    unit.apply(lambdaVisitor([&snapshot] (Script& script)
+                             {
+                                 tools::loadScriptCache(script, snapshot);
+                                 script.setCacheDirty(false);
+                             }));
+}
+
+void CacheShards::loadTree(Unit& unit)
+{
+    for (Unit* parent = unit.parent(); parent; parent = parent->parent()) {
+        loadUnit(*parent);
+    }
+
+    unit.apply(travelers::ForEach(lambdaVisitor([this] (Group& group) { loadUnit(group); })));
+    unit.apply(travelers::ForEach(lambdaVisitor([this] (Script& script) { loadUnit(script); })));
+}
+
+void CacheShards::save()
+{
+    std::set<std::string> shardNames;
+
+    for (Unit* unit : m_loaded)
+    {
+        const std::string unitPath = tools::conjurePath(*unit);
+        const auto scope = m_scopes.equal_range(unitPath);
+
+        shardNames.insert(fileName(unitPath));
+
+        bool dirty = false;
+
+        unit->apply(lambdaVisitor([&dirty] (Script& script) { dirty = script.isCacheDirty(); }));
+
+        for (auto iter = scope.first; iter != scope.second; ++iter) {
+            dirty = dirty || iter->second->isCacheDirty();
+        }
+
+        if (!dirty) {
+            continue;
+        }
+
+        //
+
+        CacheSnapshot::Writer writer;
+
+        for (auto iter = scope.first; iter != scope.second; ++iter)
+        {
+            writer.addArtifact(iter->second->name(),
+                               iter->second->storedDigest(),
+                               iter->second->getMarks());
+        }
+
+        unit->apply(lambdaVisitor([&writer] (Script& script) { tools::saveScriptCache(script, writer); }));
+
+        const std::string shardName = fileName(unitPath);
+
+        utils::safeMkdirs(shardName.substr(0, shardName.rfind('/')));
+        writer.write(shardName);
+
+        //
+
+        for (auto iter = scope.first; iter != scope.second; ++iter) {
+            iter->second->setCacheDirty(false);
+        }
+
+        unit->apply(lambdaVisitor([] (Script& script) { script.setCacheDirty(false); }));
+    }
+
+    // with the whole tree at hand, shards of units that are gone can be
+    // told apart
+
+    if (m_loaded.size() == m_unitCount
+        && isDirectory(directory()))
+    {
+        std::vector<std::string> shards;
+
+        findShards(directory(), shards);
+
+        for (const auto& shard : shards)
+        {
+            if (shardNames.count(shard) == 0) {
+                unlink(shard.c_str());
+            }
+        }
+    }
+
+    // migrated
+
+    if (m_migrated)
+    {
+        unlink(CacheSnapshot::legacyFileName().c_str());
+        unlink(CacheSnapshot::legacyArtifactsFileName().c_str());
+        unlink(CacheSnapshot::legacyStepsFileName().c_str());
+    }
+}
+
+std::string CacheShards::directory()
+{
+    return Config::instance().cache_dir + "/units";
+}
+
+std::string CacheShards::fileName(const std::string& unitPath)
+{
+    // unit names start with a digit, so "root" is free
+
+    return directory() + '/' + (unitPath.empty() ? "root" : unitPath) + ShardExt;
+}
+
+void CacheShards::exportJson(std::ostream& out)
+{
+    json j = { { "artifacts", json::object() },
+               { "steps",     json::object() } };
+
+    if (isDirectory(directory()))
+    {
+        std::vector<std::string> shards;
+
+        findShards(directory(), shards);
+
+        for (const auto& shard : shards) {
+            exportSnapshot(CacheSnapshot(shard), j);
+        }
+    }
+    else {
+        const CacheSnapshot snapshot(CacheSnapshot::legacyFileName());
+
+        if (!snapshot.isOpen()) {
+            throw std::runtime_error("no saved cache in " + Config::instance().cache_dir);
+        }
+
+        exportSnapshot(snapshot, j);
+    }
+
+    out << j.dump(1, '\t') << std::endl;
+}
+
+// ------------------------------------------------------------
+
+void CacheShards::migrate()
+{
+    const CacheJournal::Pause pause;
+    const CacheSnapshot snapshot(CacheSnapshot::legacyFileName());
+
+    if (snapshot.isOpen())
+    {
+        for (auto& artPair : m_master.artifacts) {
+            restoreArtifact(*artPair.second, snapshot);
+        }
+
+        tools::loadScriptCache(*m_master.root, snapshot);
+    }
+    else {
+        loadLegacyArtifactCache();
+        tools::loadLegacyScriptCache(*m_master.root);
+    }
+
+    // every unit is now loaded, and is saved as a shard
+
+    m_migrated = true;
+
+    m_master.root->apply(travelers::ForEach(lambdaVisitor([this] (Group& group) { m_loaded.insert(&group); })));
+    m_master.root->apply(travelers::ForEach(lambdaVisitor([this] (Script& script)
+                                                          {
+                                                              m_loaded.insert(&script);
+                                                              script.setCacheDirty();
+                                                          })));
+
+    for (auto& artPair : m_master.artifacts) {
+        artPair.second->setCacheDirty();
+    }
+}
+
+void CacheShards::loadLegacyArtifactCache()
+{
+    std::ifstream ifs(CacheSnapshot::legacyArtifactsFileName());
+
+    if (ifs) {
+        json j;
+
+        if (!(ifs >> j)) {
+            throw std::runtime_error("failed to import JSON from artifact save file");
+        }
+
+        for (const auto& j_pair : j.items())
+        {
+            auto artIter = m_master.artifacts.find(j_pair.key());
+
+            if (artIter != m_master.artifacts.end())
+            {
+                json& j_value = j_pair.value();
+
+                if (!j_value.is_object()) {
+                    throw std::runtime_error("malformed artifact save data: artifact value must be an object");
+                }
+
+                // "hash"
+
+                if (j_value.count("hash") != 1) {
+                    throw std::runtime_error("malformed artifact save data: artifact must contain hash");
+                }
+
+                if (!j_value["hash"].is_string()) {
+                    throw std::runtime_error("malformed artifact save data: artifact hash must be a string");
+                }
+
+                artIter->second->storeHash(j_value["hash"].get<std::string>());
+
+                // "marks"
+
+                if (j_value.count("marks") == 1)
+                {
+                    if (!j_value["marks"].is_object()) {
+                        throw std::runtime_error("malformed artifact save data: artifact marks must be an object");
+                    }
+
+                    for (auto& j_mark : j_value["marks"].items())
+                    {
+                        if (j_mark.value().is_string() == false) {
+                            throw std::runtime_error("malformed artifact save data: artifact marks contain non-string link type");
+                        }
+
+                        artIter->second->restoreMark( j_mark.key(),
+                                                      Artifact::Link::parse(j_mark.value().get<std::string>()) );
+                    }
+                }
+            }
+        }
+    }
+    else {
+        std::cout << "Artifact cache file does not exist." << std::endl;
+    }
+}
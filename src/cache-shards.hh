@@ -0,0 +1,85 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <string>
+
+// forward declarations
+
+class Artifact;
+struct Master;
+class Unit;
+
+//
+
+// Saved state split by unit, mirroring the unit tree under cache_dir/units:
+//
+//     units/root.snap             artifacts of the root group
+//     units/02-grp.snap           artifacts of group 02-grp
+//     units/02-grp/01-b.snap      artifacts and steps of script 02-grp/01-b
+//
+// Each shard is a CacheSnapshot. Scripts and artifacts note when their
+// saved state changes, and save() writes only the shards of those units.
+// Shards are loaded as the function at hand needs them, and a shard that
+// was not loaded is never written. Once every unit has been loaded, the
+// shards of units that no longer exist are removed.
+
+class CacheShards {
+public:
+    CacheShards(Master& master);
+    ~CacheShards();
+
+    // artifacts are added as swd_info is loaded, before their shards are
+
+    void indexArtifacts();
+
+    // saved state is still in the files of old versions, which hold every
+    // unit; it is moved into shards on the first load
+
+    bool needsMigration() const;
+
+    // the shard of 'unit' alone; or the shards of its subtree and of the
+    // groups above it, whose artifacts the subtree may link to
+
+    void loadUnit(Unit& unit);
+    void loadTree(Unit& unit);
+
+    // again, into a script whose swd_info was loaded again
+
+    void reloadUnit(Unit& unit);
+
+    void save();
+
+    //
+
+    static std::string directory();
+    static std::string fileName(const std::string& unitPath);
+
+    // all saved state in the layout of the old JSON files:
+    // { "artifacts": { ... }, "steps": { ... } }
+
+    static void exportJson(std::ostream& out);
+
+private:
+    Master& m_master;
+    std::multimap<std::string, Artifact*> m_scopes;
+    std::set<Unit*> m_loaded;
+    std::size_t m_unitCount = 0;
+    bool m_checked = false;
+    bool m_migrated = false;
+
+    //
+
+    void restoreUnit(Unit& unit);
+    void migrate();
+    void loadLegacyArtifactCache();
+
+    CacheShards(const CacheShards&) = delete;
+};
@@ -0,0 +1,517 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "cache-snapshot.hh"
+
+#include "config.hh"
+#include "utils/path.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+//
+
+struct CacheSnapshot::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;             // ByteOrder as written, so foreign files are refused
+
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+
+    uint64_t artifactsOffset;
+    uint32_t artifactCount;
+    uint32_t markCount;
+    uint64_t marksOffset;
+
+    uint64_t stepsOffset;
+    uint32_t stepCount;
+    uint32_t dependencyCount;
+    uint64_t dependenciesOffset;
+};
+
+struct CacheSnapshot::Str {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct CacheSnapshot::DigestRecord {
+    Str text;                       // algorithm of a binary digest, otherwise the whole digest
+    uint8_t kind;
+    uint8_t size;
+    uint8_t reserved[2];
+    uint8_t bytes[hashing::Digest::MaxSize];
+};
+
+struct CacheSnapshot::ArtifactRecord {
+    Str name;
+    DigestRecord hash;
+    uint32_t firstMark;
+    uint32_t markCount;
+};
+
+struct CacheSnapshot::MarkRecord {
+    Str step;
+    uint32_t type;
+};
+
+struct CacheSnapshot::StepRecord {
+    Str name;
+    uint32_t completed;
+    uint32_t firstDependency;
+    uint32_t dependencyCount;
+};
+
+struct CacheSnapshot::DependencyRecord {
+    Str id;
+    Str type;
+    DigestRecord hash;
+};
+
+//
+
+namespace
+{
+    const char Magic[8] = { 's', 'w', 'd', 's', 'n', 'a', 'p', '\n' };
+
+    enum : uint32_t {
+        Version   = 1,
+        ByteOrder = 0x01020304,
+    };
+
+    enum : uint8_t {
+        KindEmpty        = 0,
+        KindDoesNotExist = 1,
+        KindText         = 2,
+        KindBinary       = 3,
+    };
+
+    enum { SectionAlignment = 8 };
+
+    [[noreturn]] void corrupt(const std::string& fileName, const std::string& what)
+    {
+        throw std::runtime_error("corrupt cache snapshot " + fileName + ": " + what);
+    }
+}
+
+// ------------------------------------------------------------
+
+CacheSnapshot::CacheSnapshot(const std::string& fileName)
+    : m_fileName(fileName)
+{
+    const utils::OpenFile file(fileName, O_RDONLY);
+    struct stat st;
+
+    if (!file.isOpen()) {
+        return;
+    }
+
+    if (fstat(file.fd(), &st) != 0
+        || uint64_t(st.st_size) < sizeof(Header))
+    {
+        corrupt(m_fileName, "truncated header");
+    }
+
+    m_file.reset(new utils::MappedFile(file.fd(), st.st_size));
+
+    if (!m_file->isMapped()) {
+        throw std::runtime_error("failed to map cache snapshot " + fileName);
+    }
+
+    m_mapped = m_file->data();
+    m_header = reinterpret_cast<const Header*>(m_mapped);
+
+    if (std::memcmp(m_header->magic, Magic, sizeof(Magic)) != 0) {
+        corrupt(m_fileName, "not a snapshot");
+    }
+    if (m_header->version != Version) {
+        corrupt(m_fileName, "unknown version " + std::to_string(m_header->version));
+    }
+    if (m_header->byteOrder != ByteOrder) {
+        corrupt(m_fileName, "written on a machine of other byte order");
+    }
+
+    // bounds of every section are checked once here
+
+    section<char>(m_header->stringsOffset, m_header->stringsSize);
+    section<ArtifactRecord>(m_header->artifactsOffset, m_header->artifactCount);
+    section<MarkRecord>(m_header->marksOffset, m_header->markCount);
+    section<StepRecord>(m_header->stepsOffset, m_header->stepCount);
+    section<DependencyRecord>(m_header->dependenciesOffset, m_header->dependencyCount);
+}
+
+CacheSnapshot::~CacheSnapshot() = default;
+
+bool CacheSnapshot::findArtifact(const std::string& name,
+                                 hashing::Digest& hash,
+                                 std::vector<Artifact::Link>& marks) const
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    const ArtifactRecord* begin = section<ArtifactRecord>(m_header->artifactsOffset, m_header->artifactCount);
+    const ArtifactRecord* end = begin + m_header->artifactCount;
+
+    const ArtifactRecord* found = std::lower_bound(begin, end, name,
+                                                   [this] (const ArtifactRecord& record, const std::string& key)
+                                                   {
+                                                       return compare(record.name, key) < 0;
+                                                   });
+
+    if (found == end
+        || compare(found->name, name) != 0)
+    {
+        return false;
+    }
+
+    if (uint64_t(found->firstMark) + found->markCount > m_header->markCount) {
+        corrupt(m_fileName, "mark index out of range");
+    }
+
+    const MarkRecord* markRecords = section<MarkRecord>(m_header->marksOffset, m_header->markCount);
+
+    hash = digest(found->hash);
+    marks.clear();
+
+    for (uint32_t i = 0; i < found->markCount; ++i)
+    {
+        const MarkRecord& mark = markRecords[found->firstMark + i];
+
+        if (mark.type > uint32_t(Artifact::Link::Type::Simple)) {
+            corrupt(m_fileName, "unknown link type");
+        }
+
+        marks.emplace_back(string(mark.step),
+                           static_cast<Artifact::Link::Type>(mark.type));
+    }
+
+    return true;
+}
+
+bool CacheSnapshot::findStep(const std::string& name,
+                             bool& completed,
+                             std::vector<SavedDependency>& dependencies) const
+{
+    if (!isOpen()) {
+        return false;
+    }
+
+    const StepRecord* begin = section<StepRecord>(m_header->stepsOffset, m_header->stepCount);
+    const StepRecord* end = begin + m_header->stepCount;
+
+    const StepRecord* found = std::lower_bound(begin, end, name,
+                                               [this] (const StepRecord& record, const std::string& key)
+                                               {
+                                                   return compare(record.name, key) < 0;
+                                               });
+
+    if (found == end
+        || compare(found->name, name) != 0)
+    {
+        return false;
+    }
+
+    if (uint64_t(found->firstDependency) + found->dependencyCount > m_header->dependencyCount) {
+        corrupt(m_fileName, "dependency index out of range");
+    }
+
+    const DependencyRecord* records = section<DependencyRecord>(m_header->dependenciesOffset, m_header->dependencyCount);
+
+    completed = (found->completed != 0);
+    dependencies.clear();
+
+    for (uint32_t i = 0; i < found->dependencyCount; ++i)
+    {
+        const DependencyRecord& dep = records[found->firstDependency + i];
+
+        dependencies.push_back(SavedDependency{ string(dep.id),
+                                                string(dep.type),
+                                                digest(dep.hash) });
+    }
+
+    return true;
+}
+
+std::vector<std::string> CacheSnapshot::artifactNames() const
+{
+    std::vector<std::string> names;
+
+    if (isOpen())
+    {
+        const ArtifactRecord* artifacts = section<ArtifactRecord>(m_header->artifactsOffset, m_header->artifactCount);
+
+        for (uint32_t i = 0; i < m_header->artifactCount; ++i) {
+            names.push_back(string(artifacts[i].name));
+        }
+    }
+
+    return names;
+}
+
+std::vector<std::string> CacheSnapshot::stepNames() const
+{
+    std::vector<std::string> names;
+
+    if (isOpen())
+    {
+        const StepRecord* steps = section<StepRecord>(m_header->stepsOffset, m_header->stepCount);
+
+        for (uint32_t i = 0; i < m_header->stepCount; ++i) {
+            names.push_back(string(steps[i].name));
+        }
+    }
+
+    return names;
+}
+
+std::string CacheSnapshot::legacyFileName()
+{
+    return Config::instance().cache_dir + "/cache.snap";
+}
+
+std::string CacheSnapshot::legacyArtifactsFileName()
+{
+    return Config::instance().cache_dir + "/artifacts.json";
+}
+
+std::string CacheSnapshot::legacyStepsFileName()
+{
+    return Config::instance().cache_dir + "/steps.json";
+}
+
+std::string CacheSnapshot::string(const Str& str) const
+{
+    if (uint64_t(str.offset) + str.size > m_header->stringsSize) {
+        corrupt(m_fileName, "string out of range");
+    }
+
+    return std::string(reinterpret_cast<const char*>(m_mapped + m_header->stringsOffset + str.offset),
+                       str.size);
+}
+
+int CacheSnapshot::compare(const Str& str, const std::string& key) const
+{
+    if (uint64_t(str.offset) + str.size > m_header->stringsSize) {
+        corrupt(m_fileName, "string out of range");
+    }
+
+    const void* data = m_mapped + m_header->stringsOffset + str.offset;
+    const int result = std::memcmp(data, key.data(), std::min<std::size_t>(str.size, key.size()));
+
+    if (result != 0) {
+        return result;
+    }
+
+    return (str.size < key.size() ? -1
+            : str.size > key.size() ? 1
+            : 0);
+}
+
+hashing::Digest CacheSnapshot::digest(const DigestRecord& record) const
+{
+    switch (record.kind) {
+    case KindEmpty:        return hashing::Digest();
+    case KindDoesNotExist: return hashing::Digest::doesNotExist();
+    case KindText:         return hashing::Digest::parse(string(record.text));
+    case KindBinary:
+        if (record.size > hashing::Digest::MaxSize) {
+            corrupt(m_fileName, "digest too long");
+        }
+
+        return hashing::Digest::fromBinary(string(record.text), record.bytes, record.size);
+    }
+
+    corrupt(m_fileName, "unknown digest kind");
+}
+
+template< typename Record >
+const Record* CacheSnapshot::section(uint64_t offset, uint64_t count) const
+{
+    if (offset % alignof(Record) != 0
+        || offset > m_file->size()
+        || (m_file->size() - offset) / sizeof(Record) < count)
+    {
+        corrupt(m_fileName, "section out of range");
+    }
+
+    return reinterpret_cast<const Record*>(m_mapped + offset);
+}
+
+// ------------------------------------------------------------
+
+void CacheSnapshot::Writer::addArtifact(const std::string& name,
+                                        const hashing::Digest& hash,
+                                        const std::vector<Artifact::Link>& marks)
+{
+    m_artifacts[name] = ArtifactData{ hash, marks };
+}
+
+void CacheSnapshot::Writer::addStep(const std::string& name,
+                                    bool completed,
+                                    const std::vector<SavedDependency>& dependencies)
+{
+    m_steps[name] = StepData{ completed, dependencies };
+}
+
+void CacheSnapshot::Writer::write(const std::string& fileName) const
+{
+    std::string strings;
+    std::unordered_map<std::string, Str> stringIndex;
+
+    const auto addString = [&strings, &stringIndex] (const std::string& s)
+        {
+            const auto iter = stringIndex.find(s);
+
+            if (iter != stringIndex.end()) {
+                return iter->second;
+            }
+
+            const Str str{ uint32_t(strings.size()), uint32_t(s.size()) };
+
+            strings += s;
+            stringIndex.emplace(s, str);
+
+            return str;
+        };
+
+    const auto addDigest = [&addString] (const hashing::Digest& digest)
+        {
+            DigestRecord record;
+
+            std::memset(&record, 0, sizeof(record));
+
+            if (digest.empty()) {
+                record.kind = KindEmpty;
+            }
+            else if (digest.isDoesNotExist()) {
+                record.kind = KindDoesNotExist;
+            }
+            else if (digest.isBinary()) {
+                record.kind = KindBinary;
+                record.text = addString(digest.algorithm());
+                record.size = uint8_t(digest.size());
+                std::memcpy(record.bytes, digest.bytes(), digest.size());
+            }
+            else {
+                record.kind = KindText;
+                record.text = addString(digest.str());
+            }
+
+            return record;
+        };
+
+    // records; the maps keep them sorted by name
+
+    std::vector<ArtifactRecord> artifacts;
+    std::vector<MarkRecord> marks;
+    std::vector<StepRecord> steps;
+    std::vector<DependencyRecord> dependencies;
+
+    for (const auto& pair : m_artifacts)
+    {
+        artifacts.push_back(ArtifactRecord{ addString(pair.first),
+                                            addDigest(pair.second.hash),
+                                            uint32_t(marks.size()),
+                                            uint32_t(pair.second.marks.size()) });
+
+        for (const auto& mark : pair.second.marks) {
+            marks.push_back(MarkRecord{ addString(mark.name), uint32_t(mark.type) });
+        }
+    }
+
+    for (const auto& pair : m_steps)
+    {
+        steps.push_back(StepRecord{ addString(pair.first),
+                                    pair.second.completed ? 1u : 0u,
+                                    uint32_t(dependencies.size()),
+                                    uint32_t(pair.second.dependencies.size()) });
+
+        for (const auto& dep : pair.second.dependencies) {
+            dependencies.push_back(DependencyRecord{ addString(dep.id),
+                                                     addString(dep.type),
+                                                     addDigest(dep.hash) });
+        }
+    }
+
+    // layout
+
+    const auto align = [] (uint64_t offset)
+        {
+            return (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+        };
+
+    Header header;
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+
+    header.version = Version;
+    header.byteOrder = ByteOrder;
+
+    header.stringsOffset = sizeof(Header);
+    header.stringsSize = strings.size();
+
+    header.artifactsOffset = align(header.stringsOffset + header.stringsSize);
+    header.artifactCount = artifacts.size();
+
+    header.marksOffset = align(header.artifactsOffset + artifacts.size() * sizeof(ArtifactRecord));
+    header.markCount = marks.size();
+
+    header.stepsOffset = align(header.marksOffset + marks.size() * sizeof(MarkRecord));
+    header.stepCount = steps.size();
+
+    header.dependenciesOffset = align(header.stepsOffset + steps.size() * sizeof(StepRecord));
+    header.dependencyCount = dependencies.size();
+
+    //
+
+    utils::safeMkdir(Config::instance().cache_dir);
+
+    const std::string tmpName = fileName + ".tmp";
+
+    std::ofstream ofs(tmpName, std::ios::binary);
+
+    if (!ofs) {
+        throw std::runtime_error("failed to open cache snapshot file: " + tmpName);
+    }
+
+    uint64_t written = 0;
+
+    const auto put = [&ofs, &written] (uint64_t offset, const void* data, std::size_t size)
+        {
+            static const char Padding[SectionAlignment] = {};
+
+            ofs.write(Padding, offset - written);
+            ofs.write(static_cast<const char*>(data), size);
+
+            written = offset + size;
+        };
+
+    put(0, &header, sizeof(header));
+    put(header.stringsOffset, strings.data(), strings.size());
+    put(header.artifactsOffset, artifacts.data(), artifacts.size() * sizeof(ArtifactRecord));
+    put(header.marksOffset, marks.data(), marks.size() * sizeof(MarkRecord));
+    put(header.stepsOffset, steps.data(), steps.size() * sizeof(StepRecord));
+    put(header.dependenciesOffset, dependencies.data(), dependencies.size() * sizeof(DependencyRecord));
+
+    if (!(ofs << std::flush)) {
+        throw std::runtime_error("failed to save cache snapshot");
+    }
+
+    ofs.close();
+
+    if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + fileName + "'");
+    }
+}
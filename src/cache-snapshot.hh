@@ -0,0 +1,120 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include "hash-cache.hh"
+#include "hash-digest.hh"
+#include "utils/mapped-file.hh"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Saved state of artifacts and steps, one file per unit (see
+// cache-shards.hh):
+//
+//     header
+//     string table        names, ids and text digests, no separators
+//     artifact records    sorted by name
+//     mark records        per artifact, contiguous
+//     step records        sorted by name
+//     dependency records  per step, contiguous
+//
+// Records have a fixed size and refer to strings by offset and length, and
+// digests are stored in binary, so the file is mapped as is and only the
+// records that are looked up are decoded.
+//
+// Older trees have everything in one snapshot, cache_dir/cache.snap, or
+// before that in artifacts.json and steps.json; those are read when there
+// are no shards and removed once the shards have been written.
+
+class CacheSnapshot {
+public:
+    struct SavedDependency {
+        std::string id;
+        std::string type;
+        hashing::Digest hash;
+    };
+
+    //
+
+    CacheSnapshot(const std::string& fileName);     // !isOpen() if there is no such file
+    ~CacheSnapshot();
+
+    bool isOpen() const { return m_mapped != nullptr; }
+
+    bool findArtifact(const std::string& name,
+                      hashing::Digest& hash,
+                      std::vector<Artifact::Link>& marks) const;
+    bool findStep(const std::string& name,
+                  bool& completed,
+                  std::vector<SavedDependency>& dependencies) const;
+
+    std::vector<std::string> artifactNames() const;
+    std::vector<std::string> stepNames() const;
+
+    //
+
+    static std::string legacyFileName();
+    static std::string legacyArtifactsFileName();
+    static std::string legacyStepsFileName();
+
+    // -----
+
+    class Writer {
+    public:
+        void addArtifact(const std::string& name,
+                         const hashing::Digest& hash,
+                         const std::vector<Artifact::Link>& marks);
+        void addStep(const std::string& name,
+                     bool completed,
+                     const std::vector<SavedDependency>& dependencies);
+
+        void write(const std::string& fileName) const;
+
+    private:
+        struct ArtifactData {
+            hashing::Digest hash;
+            std::vector<Artifact::Link> marks;
+        };
+
+        struct StepData {
+            bool completed;
+            std::vector<SavedDependency> dependencies;
+        };
+
+        std::map<std::string, ArtifactData> m_artifacts;
+        std::map<std::string, StepData> m_steps;
+    };
+
+private:
+    struct Header;
+    struct Str;
+    struct DigestRecord;
+    struct ArtifactRecord;
+    struct MarkRecord;
+    struct StepRecord;
+    struct DependencyRecord;
+
+    std::string m_fileName;
+    std::unique_ptr<utils::MappedFile> m_file;
+    const uint8_t* m_mapped = nullptr;
+    const Header* m_header = nullptr;
+
+    //
+
+    std::string string(const Str& str) const;
+    int compare(const Str& str, const std::string& key) const;
+    hashing::Digest digest(const DigestRecord& record) const;
+
+    template< typename Record >
+    const Record* section(uint64_t offset, uint64_t count) const;
+
+    CacheSnapshot(const CacheSnapshot&) = delete;
+};
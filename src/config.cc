@@ -6,6 +6,8 @@
 
 #include "config.hh"
 
+#include "utils/parallel.hh"
+
 #include <csignal>
 #include <cstring>
 #include <fstream>
@@ -76,6 +78,20 @@ namespace
 
 // ------------------------------------------------------------
 
+unsigned int Config::hashThreads() const
+{
+    return (hash_threads > 0
+            ? hash_threads
+            : utils::hardwareThreads());
+}
+
+unsigned int Config::swdInfoJobs() const
+{
+    return (swd_info_jobs > 0
+            ? swd_info_jobs
+            : utils::hardwareThreads());
+}
+
 const Config& Config::instance()
 {
     static Config s_config(s_interrupted);
@@ -202,12 +218,86 @@ Config::Config(volatile bool& i)
                 throw runtime_error("configuration error: invalid 'env'");
             }
         }
+        else if (token == "hash_algo")
+        {
+            if (!(iss >> hash_algo)) {
+                throw runtime_error("configuration error: invalid 'hash_algo'");
+            }
+        }
         else if (token == "hash_bin")
         {
             if (!(iss >> hash_bin)) {
                 throw runtime_error("configuration error: invalid 'hash_bin'");
             }
         }
+        else if (token == "hash_bin_mode")
+        {
+            if (!(iss >> hash_bin_mode)
+                || (hash_bin_mode != "exec"
+                    && hash_bin_mode != "coprocess"))
+            {
+                throw runtime_error("configuration error: invalid 'hash_bin_mode'");
+            }
+        }
+        else if (token == "hash_bandwidth")
+        {
+            if (!(iss >> hash_bandwidth)) {
+                throw runtime_error("configuration error: invalid 'hash_bandwidth'");
+            }
+        }
+        else if (token == "hash_readahead")
+        {
+            string value;
+
+            if (!(iss >> value)
+                || (value != "yes"
+                    && value != "no"))
+            {
+                throw runtime_error("configuration error: invalid 'hash_readahead'");
+            }
+
+            hash_readahead = (value == "yes");
+        }
+        else if (token == "hash_threads")
+        {
+            if (!(iss >> hash_threads)) {
+                throw runtime_error("configuration error: invalid 'hash_threads'");
+            }
+        }
+        else if (token == "hash_tree_threshold")
+        {
+            if (!(iss >> hash_tree_threshold)) {
+                throw runtime_error("configuration error: invalid 'hash_tree_threshold'");
+            }
+        }
+        else if (token == "hash_uncached_mode")
+        {
+            if (!(iss >> hash_uncached_mode)
+                || (hash_uncached_mode != "dontneed"
+                    && hash_uncached_mode != "direct"))
+            {
+                throw runtime_error("configuration error: invalid 'hash_uncached_mode'");
+            }
+        }
+        else if (token == "hash_uncached_size")
+        {
+            if (!(iss >> hash_uncached_size)) {
+                throw runtime_error("configuration error: invalid 'hash_uncached_size'");
+            }
+        }
+        else if (token == "hash_xattr")
+        {
+            string value;
+
+            if (!(iss >> value)
+                || (value != "yes"
+                    && value != "no"))
+            {
+                throw runtime_error("configuration error: invalid 'hash_xattr'");
+            }
+
+            hash_xattr = (value == "yes");
+        }
         else if (token == "hashsum_size")
         {
             if (!(iss >> hashsum_size)) {
@@ -223,6 +313,31 @@ Config::Config(volatile bool& i)
                 throw runtime_error("configuration error: invalid 'root'");
             }
         }
+        else if (token == "step_zygote")
+        {
+            if (!(iss >> step_zygote)) {
+                throw runtime_error("configuration error: invalid 'step_zygote'");
+            }
+        }
+        else if (token == "swd_info_cache")
+        {
+            string value;
+
+            if (!(iss >> value)
+                || (value != "yes"
+                    && value != "no"))
+            {
+                throw runtime_error("configuration error: invalid 'swd_info_cache'");
+            }
+
+            swd_info_cache = (value == "yes");
+        }
+        else if (token == "swd_info_jobs")
+        {
+            if (!(iss >> swd_info_jobs)) {
+                throw runtime_error("configuration error: invalid 'swd_info_jobs'");
+            }
+        }
     }
 }
 
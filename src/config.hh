@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 struct Config {
@@ -13,8 +14,20 @@ struct Config {
     std::string cache_dir = ".swd-cache";
 
     std::string bash_bin = "/bin/bash";
-    std::string hash_bin = "/usr/bin/sha256sum";
+    std::string hash_algo = "sha256";
+    std::string hash_bin;                   // overrides hash_algo
+    std::string hash_bin_mode = "exec";     // or "coprocess"
     std::string::size_type hashsum_size = 64;
+    unsigned int hash_threads = 0;          // 0: one per CPU
+    uint64_t hash_tree_threshold = 64 * 1024 * 1024;    // 0: never
+    bool hash_readahead = false;
+    uint64_t hash_uncached_size = 0;        // 0: never
+    std::string hash_uncached_mode = "dontneed";        // or "direct"
+    uint64_t hash_bandwidth = 0;            // bytes per second, 0: unlimited
+    bool hash_xattr = false;
+    std::string step_zygote;                // worker running steps, see StepZygote
+    bool swd_info_cache = true;
+    unsigned int swd_info_jobs = 0;         // 0: one per CPU
 
     //
 
@@ -22,6 +35,9 @@ struct Config {
 
     //
 
+    unsigned int hashThreads() const;
+    unsigned int swdInfoJobs() const;
+
     static const Config& instance();
 
     static void setenv(const std::string& name,
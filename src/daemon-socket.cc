@@ -0,0 +1,553 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "daemon-socket.hh"
+
+#include "config.hh"
+#include "utils/path.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    // the listening socket, the pending client and its request, over the
+    // exec of a new daemon
+
+    const char* const InheritedFds = "SWD_DAEMON_FDS";
+
+    enum { PollInterval = 500 };        // ms, for noticing SIGINT
+
+    // A client sends its request at once. One that does not, or sends
+    // too much, is dropped instead of holding up the clients after it.
+
+    enum { RequestTimeout = 2000 };     // ms
+    enum { MaxRequestSize = 64 * 1024 };
+
+    // the environment swd was started with, sorted: taken before main(),
+    // so before .swd.conf has added to it
+
+    std::vector<std::string> startEnvironment()
+    {
+        const std::string inherited = std::string(InheritedFds) + '=';
+
+        std::vector<std::string> variables;
+
+        for (char** e = environ; *e; ++e)
+        {
+            if (strncmp(*e, inherited.c_str(), inherited.size()) != 0) {
+                variables.push_back(*e);
+            }
+        }
+
+        std::sort(variables.begin(), variables.end());
+
+        return variables;
+    }
+
+    const std::vector<std::string> s_environment = startEnvironment();
+
+    //
+
+    sockaddr_un address()
+    {
+        const std::string name = DaemonSocket::fileName();
+
+        sockaddr_un addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+
+        if (name.size() >= sizeof(addr.sun_path)) {
+            throw std::runtime_error("socket path too long: " + name);
+        }
+
+        strcpy(addr.sun_path, name.c_str());
+        return addr;
+    }
+
+    int newSocket()
+    {
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+        if (fd < 0) {
+            throw std::runtime_error(std::string("socket: ") + strerror(errno));
+        }
+
+        return fd;
+    }
+
+    // -1 if there is no daemon
+
+    int connectDaemon()
+    {
+        const sockaddr_un addr = address();
+        const int fd = newSocket();
+
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    int listenDaemon()
+    {
+        const std::string name = DaemonSocket::fileName();
+
+        const int running = connectDaemon();
+
+        if (running >= 0) {
+            close(running);
+            throw std::runtime_error("swd daemon already running on " + name);
+        }
+
+        utils::safeMkdirs(Config::instance().cache_dir);
+        unlink(name.c_str());                       // left by a daemon that was killed
+
+        const sockaddr_un addr = address();
+        const int fd = newSocket();
+
+        if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0
+            || listen(fd, SOMAXCONN) != 0)
+        {
+            const std::string error = strerror(errno);
+
+            close(fd);
+            throw std::runtime_error(name + ": " + error);
+        }
+
+        return fd;
+    }
+
+    //
+
+    void writeAll(int fd, const char* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = write(fd, data, size);
+
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw std::runtime_error(std::string("write: ") + strerror(errno));
+            }
+
+            data += written;
+            size -= written;
+        }
+    }
+
+    // until the client shuts down its end
+
+    std::string readAll(int fd)
+    {
+        using namespace std::chrono;
+
+        const auto deadline = steady_clock::now() + milliseconds(RequestTimeout);
+
+        std::string data;
+        char buffer[4096];
+
+        for (;;)
+        {
+            const auto left = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+
+            if (left <= 0) {
+                throw std::runtime_error("request timed out");
+            }
+
+            pollfd pfd;
+
+            pfd.fd = fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            const int ready = poll(&pfd, 1, left);
+
+            if (ready < 0
+                && errno != EINTR)
+            {
+                throw std::runtime_error(std::string("poll: ") + strerror(errno));
+            }
+            else if (ready <= 0) {
+                continue;
+            }
+
+            const ssize_t got = read(fd, buffer, sizeof(buffer));
+
+            if (got > 0) {
+                data.append(buffer, got);
+
+                if (data.size() > MaxRequestSize) {
+                    throw std::runtime_error("request too large");
+                }
+            }
+            else if (got == 0) {
+                return data;
+            }
+            else if (errno != EINTR) {
+                throw std::runtime_error(std::string("read: ") + strerror(errno));
+            }
+        }
+    }
+
+    // false for a connection that only checked for a daemon
+    //
+    // the arguments, each terminated by a NUL, and an empty one; then the
+    // environment of the client the same way
+
+    bool parseRequest(const std::string& data,
+                      std::vector<std::string>& args,
+                      std::vector<std::string>& environment)
+    {
+        std::vector<std::string>* fields = &args;
+        std::string::size_type begin = 0;
+
+        for (std::string::size_type end; (end = data.find('\0', begin)) != std::string::npos; begin = end + 1)
+        {
+            if (end > begin) {
+                fields->push_back(data.substr(begin, end - begin));
+            }
+            else if (fields == &args) {
+                fields = &environment;
+            }
+            else {
+                return begin + 1 == data.size();
+            }
+        }
+
+        return false;
+    }
+
+    //
+
+    // stdout and stderr of swd, and so of the steps it runs, on 'fd' for the
+    // time of a request
+
+    class Redirect {
+    public:
+        Redirect(int fd)
+        {
+            flush();
+
+            m_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+            m_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+
+            if (m_stdout < 0
+                || m_stderr < 0
+                || dup2(fd, STDOUT_FILENO) < 0
+                || dup2(fd, STDERR_FILENO) < 0)
+            {
+                const std::string error = strerror(errno);
+
+                restore();
+                throw std::runtime_error("redirecting output: " + error);
+            }
+        }
+
+        ~Redirect()
+        {
+            flush();
+            restore();
+        }
+
+    private:
+        int m_stdout = -1;
+        int m_stderr = -1;
+
+        //
+
+        // a failed stream does not flush; a client that went away, or a
+        // step printing nothing, leaves std::cout failed
+
+        static void flush()
+        {
+            std::cout.clear();
+            std::cerr.clear();
+
+            std::cout.flush();
+            std::cerr.flush();
+
+            std::cout.clear();
+            std::cerr.clear();
+        }
+
+        void restore()
+        {
+            if (m_stdout >= 0) {
+                dup2(m_stdout, STDOUT_FILENO);
+                close(m_stdout);
+            }
+
+            if (m_stderr >= 0) {
+                dup2(m_stderr, STDERR_FILENO);
+                close(m_stderr);
+            }
+        }
+    };
+
+    //
+
+    // the request, already read, goes to the new daemon in a memfd
+
+    [[noreturn]] void execDaemon(int listenFd,
+                                 int clientFd,
+                                 const std::string& request,
+                                 const std::vector<std::string>& environment)
+    {
+        const int requestFd = memfd_create("swd-request", 0);
+
+        if (requestFd < 0) {
+            throw std::runtime_error(std::string("memfd_create: ") + strerror(errno));
+        }
+
+        writeAll(requestFd, request.data(), request.size());
+        lseek(requestFd, 0, SEEK_SET);
+
+        fcntl(listenFd, F_SETFD, 0);
+        fcntl(clientFd, F_SETFD, 0);
+
+        std::vector<std::string> variables = environment;
+
+        variables.push_back(std::string(InheritedFds) + '='
+                            + std::to_string(listenFd) + ' '
+                            + std::to_string(clientFd) + ' '
+                            + std::to_string(requestFd));
+
+        std::vector<char*> envp;
+
+        for (auto& variable : variables) {
+            envp.push_back(&variable[0]);
+        }
+
+        envp.push_back(nullptr);
+
+        char swd[] = "swd";
+        char daemon[] = "--daemon";
+        char* const argv[] = { swd, daemon, nullptr };
+
+        execve("/proc/self/exe", argv, envp.data());
+
+        throw std::runtime_error(std::string("exec of new swd daemon failed: ") + strerror(errno));
+    }
+}
+
+// ------------------------------------------------------------
+
+void DaemonSocket::serve(const refresh_t& refresh, const request_t& request)
+{
+    const Config& conf = Config::instance();
+
+    // writing to a client that went away fails instead
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int listenFd = -1;
+    int pendingFd = -1;
+    int pendingRequestFd = -1;
+
+    if (const char* inherited = getenv(InheritedFds))
+    {
+        std::istringstream iss(inherited);
+
+        if (!(iss >> listenFd >> pendingFd >> pendingRequestFd)) {
+            throw std::runtime_error(std::string("invalid ") + InheritedFds + ": " + inherited);
+        }
+
+        unsetenv(InheritedFds);
+
+        fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+        fcntl(pendingFd, F_SETFD, FD_CLOEXEC);
+        fcntl(pendingRequestFd, F_SETFD, FD_CLOEXEC);
+    }
+    else {
+        listenFd = listenDaemon();
+
+        std::cout << "swd daemon listening on " << fileName() << std::endl;
+    }
+
+    while (!conf.interrupted)
+    {
+        int clientFd = pendingFd;
+        const int requestFd = pendingRequestFd;
+
+        pendingFd = -1;
+        pendingRequestFd = -1;
+
+        if (clientFd < 0)
+        {
+            pollfd pfd;
+
+            pfd.fd = listenFd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            if (poll(&pfd, 1, PollInterval) <= 0) {
+                continue;
+            }
+
+            clientFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+
+            if (clientFd < 0) {
+                continue;
+            }
+        }
+
+        // a client in another environment, or a changed tree, is served
+        // by a new daemon
+
+        std::string data;
+        std::vector<std::string> environment;
+        bool exec = false;
+        bool unread = true;
+
+        try {
+            const Redirect redirect(clientFd);
+
+            try {
+                std::vector<std::string> args;
+
+                unread = false;                 // also if it times out
+                data = readAll(requestFd >= 0 ? requestFd : clientFd);
+
+                if (parseRequest(data, args, environment))
+                {
+                    std::sort(environment.begin(), environment.end());
+
+                    if (environment != s_environment
+                        || !refresh())
+                    {
+                        exec = true;
+                    }
+                    else {
+                        request(args);
+                    }
+                }
+            }
+            catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+        catch (std::exception& e) {
+            std::cerr << "swd daemon: " << e.what() << std::endl;
+        }
+
+        if (exec) {
+            execDaemon(listenFd, clientFd, data, environment);
+        }
+
+        // a request left unread would reset the connection, and the client
+        // could lose the end of the output
+
+        if (unread) {
+            try {
+                readAll(clientFd);
+            }
+            catch (std::exception&) {}
+        }
+
+        if (requestFd >= 0) {
+            close(requestFd);
+        }
+
+        close(clientFd);
+    }
+
+    close(listenFd);
+    unlink(fileName().c_str());
+}
+
+bool DaemonSocket::forward(const std::vector<std::string>& args)
+{
+    const int fd = connectDaemon();
+
+    if (fd < 0) {
+        return false;
+    }
+
+    try {
+        std::string data;
+
+        for (const auto& arg : args) {
+            data += arg;
+            data += '\0';
+        }
+
+        data += '\0';
+
+        for (const auto& variable : s_environment) {
+            data += variable;
+            data += '\0';
+        }
+
+        data += '\0';
+
+        writeAll(fd, data.data(), data.size());
+        shutdown(fd, SHUT_WR);
+
+        char buffer[4096];
+
+        for (;;)
+        {
+            const ssize_t got = read(fd, buffer, sizeof(buffer));
+
+            if (got > 0) {
+                writeAll(STDOUT_FILENO, buffer, got);
+            }
+            else if (got == 0) {
+                break;
+            }
+            else if (errno != EINTR) {
+                throw std::runtime_error(std::string("read: ") + strerror(errno));
+            }
+        }
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+
+    close(fd);
+    return true;
+}
+
+bool DaemonSocket::isRunning()
+{
+    const int fd = connectDaemon();
+
+    if (fd < 0) {
+        return false;
+    }
+
+    close(fd);
+    return true;
+}
+
+std::string DaemonSocket::fileName()
+{
+    return Config::instance().cache_dir + "/daemon.sock";
+}
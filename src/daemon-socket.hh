@@ -0,0 +1,46 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// "swd --daemon" keeps one Master resident and serves the other swd runs
+// of the tree over the Unix socket cache_dir/daemon.sock. A client sends
+// its arguments and then the environment it was started with, each entry
+// terminated by a NUL and each list by an empty one, and shuts down its
+// end. The daemon runs the function with its stdout and stderr on the
+// connection, so the client gets the output of swd and of the steps, and
+// closes the connection when done. One client is served at a time.
+//
+// Steps are run in the client's environment, with .swd.conf applied over
+// it as without a daemon; no variable is taken from the daemon. Both work
+// in the directory of .swd.conf, so the working directory is the same too.
+//
+// Before each request the daemon checks the tree. When the client's
+// environment differs from the daemon's, a unit has been added or removed,
+// or a group file has changed, the daemon execs itself in the client's
+// environment, keeping the socket, the pending client and its request.
+// The state is saved after every request, so there is nothing to save.
+
+class DaemonSocket {
+public:
+    using refresh_t = std::function<bool()>;        // false: exec a new daemon
+    using request_t = std::function<void(const std::vector<std::string>& args)>;
+
+    // until interrupted
+
+    static void serve(const refresh_t& refresh, const request_t& request);
+
+    // false if no daemon is running
+
+    static bool forward(const std::vector<std::string>& args);
+    static bool isRunning();
+
+    static std::string fileName();
+};
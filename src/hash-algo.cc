@@ -0,0 +1,107 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-algo.hh"
+
+#include "config.hh"
+#include "hash-cache.hh"
+#include "utils/blake3.hh"
+#include "utils/sha256.hh"
+#include "utils/xxh3.hh"
+
+#include <stdexcept>
+
+//
+
+namespace
+{
+    template< typename Impl >
+    class HasherT : public hashing::Hasher {
+    public:
+        void update(const void* data, std::size_t size) override
+        {
+            m_impl.update(data, size);
+        }
+
+        std::string hexdigest() override
+        {
+            return m_impl.hexdigest();
+        }
+
+        static hashing::unique_hasher_t create()
+        {
+            return std::make_unique<HasherT<Impl>>();
+        }
+
+    private:
+        Impl m_impl;
+    };
+
+    //
+
+    const hashing::Algorithm s_algorithms[] = {
+        { "blake3",   &HasherT<utils::Blake3>::create   },
+        { "sha256",   &HasherT<utils::Sha256>::create   },
+        { "xxh3-128", &HasherT<utils::Xxh3_128>::create },
+    };
+
+    const std::string LegacyAlgorithm = "sha256";
+}
+
+// ------------------------------------------------------------
+
+const std::string hashing::DirectoryTag = "dir2";
+const std::string hashing::HashBinTag = "hash_bin";
+const std::string hashing::MetadataTag = "metadata";
+const std::string hashing::SampledTag = "sampled";
+
+const hashing::Algorithm& hashing::find(const std::string& name)
+{
+    for (const auto& algo : s_algorithms)
+    {
+        if (algo.name == name) {
+            return algo;
+        }
+    }
+
+    throw std::runtime_error("unknown hash algorithm '" + name + "'");
+}
+
+const hashing::Algorithm& hashing::configured()
+{
+    const std::string& name = Config::instance().hash_algo;
+
+    for (const auto& algo : s_algorithms)
+    {
+        if (algo.name == name) {
+            return algo;
+        }
+    }
+
+    throw std::runtime_error("configuration error: unknown hash_algo '" + name + "'");
+}
+
+std::string hashing::tag(const std::string& algorithm, const std::string& hex)
+{
+    return algorithm + ':' + hex;
+}
+
+std::string hashing::algorithmOf(const std::string& digest)
+{
+    if (digest.empty()
+        || digest == HashCache::TargetDoesNotExist)
+    {
+        return "";
+    }
+
+    const std::string::size_type colon = digest.find(':');
+
+    if (colon == std::string::npos) {
+        return LegacyAlgorithm;
+    }
+
+    return digest.substr(0, colon);
+}
@@ -0,0 +1,49 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace hashing
+{
+    class Hasher {
+    public:
+        virtual ~Hasher() = default;
+
+        virtual void update(const void* data, std::size_t size) = 0;
+        virtual std::string hexdigest() = 0;
+    };
+
+    using unique_hasher_t = std::unique_ptr<Hasher>;
+
+    //
+
+    struct Algorithm {
+        std::string name;
+        unique_hasher_t (*create)();
+    };
+
+    const Algorithm& find(const std::string& name);
+    const Algorithm& configured();
+
+    // Stored digests are "<algorithm>:<hex>". A bare hex string is a digest
+    // written before algorithms were tagged, which means sha256.
+    //
+    // Metadata digests of directory artifacts are tagged "dir2", apart from
+    // the digests of the `find` listing they replaced, so that those are
+    // rebaselined instead of read as changes.
+
+    extern const std::string DirectoryTag;
+    extern const std::string HashBinTag;
+    extern const std::string MetadataTag;
+    extern const std::string SampledTag;
+
+    std::string tag(const std::string& algorithm, const std::string& hex);
+    std::string algorithmOf(const std::string& digest);
+}
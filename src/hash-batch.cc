@@ -0,0 +1,315 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-batch.hh"
+
+#include "config.hh"
+#include "hash-algo.hh"
+#include "hash-cache.hh"
+#include "hash-io.hh"
+#include "hash-tools.hh"
+#include "hash-tree.hh"
+#include "hash-xattr.hh"
+#include "stat-cache.hh"
+#include "utils/parallel.hh"
+#include "utils/uring.hh"
+
+#include <cstdlib>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    struct PendingFile {
+        std::size_t index;          // into the results
+        const std::string* path;
+        StatCache::Key key;
+    };
+
+    // io_uring: every slot walks one file through open, reads and close;
+    // the slot number and operation are packed into user_data
+
+    class UringHasher {
+    public:
+        enum {
+            Depth     = 32,
+            BlockSize = 256 * 1024,
+        };
+
+        UringHasher(utils::IoUring& ring,
+                    const std::vector<PendingFile>& files,
+                    std::vector<std::string>& results)
+            : m_ring(ring),
+              m_files(files),
+              m_results(results),
+              m_algo(hashing::configured()),
+              m_policy(hashing::IoPolicy::configured()),
+              m_hashedAt(StatCache::now())
+        {
+        }
+
+        void run()
+        {
+            std::size_t active = 0;
+
+            for (auto& slot : m_slots)
+            {
+                if (start(slot)) {
+                    ++active;
+                }
+            }
+
+            while (active > 0)
+            {
+                const auto completion = m_ring.wait();
+                Slot& slot = m_slots[completion.userData >> 1];
+
+                const bool done = ((completion.userData & 1) == OpOpen
+                                   ? opened(slot, completion.result)
+                                   : readDone(slot, completion.result));
+
+                if (done
+                    && !start(slot))
+                {
+                    --active;
+                }
+            }
+        }
+
+    private:
+        enum { OpOpen = 0, OpRead = 1 };
+
+        struct Slot {
+            std::size_t file = 0;
+            int fd = -1;
+            uint64_t offset = 0;
+            hashing::unique_hasher_t hasher;
+            std::unique_ptr<uint8_t[]> buffer;
+        };
+
+        utils::IoUring& m_ring;
+        const std::vector<PendingFile>& m_files;
+        std::vector<std::string>& m_results;
+        const hashing::Algorithm& m_algo;
+        const hashing::IoPolicy& m_policy;
+        const int64_t m_hashedAt;
+
+        Slot m_slots[Depth];
+        std::size_t m_next = 0;
+
+        //
+
+        uint64_t userData(const Slot& slot, int op) const
+        {
+            return (uint64_t(&slot - m_slots) << 1) | op;
+        }
+
+        // takes the next file; false if there are none left
+
+        bool start(Slot& slot)
+        {
+            while (m_next < m_files.size())
+            {
+                slot.file = m_next++;
+                slot.fd = -1;
+                slot.offset = 0;
+                slot.hasher = m_algo.create();
+
+                if (m_ring.openat(AT_FDCWD, m_files[slot.file].path->c_str(), O_RDONLY | O_CLOEXEC,
+                                  userData(slot, OpOpen)))
+                {
+                    return true;
+                }
+
+                fallback(slot);
+            }
+
+            return false;
+        }
+
+        // each returns true when the slot's file is finished
+
+        bool opened(Slot& slot, int result)
+        {
+            if (result < 0) {
+                fallback(slot);         // not there anymore, or the kernel lacks the operation
+                return true;
+            }
+
+            slot.fd = result;
+
+            if (m_policy.readahead) {
+                posix_fadvise(slot.fd, 0, 0, POSIX_FADV_WILLNEED);
+            }
+
+            if (!slot.buffer) {
+                slot.buffer.reset(new uint8_t[BlockSize]);
+            }
+
+            return !queueRead(slot);
+        }
+
+        bool readDone(Slot& slot, int result)
+        {
+            if (result < 0) {
+                fallback(slot);
+                return true;
+            }
+
+            if (result > 0)
+            {
+                m_policy.throttle(result);
+
+                slot.hasher->update(slot.buffer.get(), result);
+                slot.offset += result;
+
+                return !queueRead(slot);
+            }
+
+            // end of file
+
+            close(slot.fd);
+            slot.fd = -1;
+
+            const PendingFile& file = m_files[slot.file];
+
+            if (slot.offset == 0) {
+                m_results[file.index] = HashCache::TargetDoesNotExist;
+            }
+            else {
+                m_results[file.index] = hashing::tag(hashing::fileTag(m_algo), slot.hasher->hexdigest());
+                StatCache::instance().store(*file.path, file.key, m_hashedAt, m_results[file.index]);
+                hashing::storeXattrDigest(*file.path, file.key, m_hashedAt, m_results[file.index]);
+            }
+
+            return true;
+        }
+
+        bool queueRead(Slot& slot)
+        {
+            if (m_ring.read(slot.fd, slot.buffer.get(), BlockSize, slot.offset, userData(slot, OpRead))) {
+                return true;
+            }
+
+            fallback(slot);
+            return false;
+        }
+
+        void fallback(Slot& slot)
+        {
+            if (slot.fd >= 0) {
+                close(slot.fd);
+                slot.fd = -1;
+            }
+
+            const PendingFile& file = m_files[slot.file];
+
+            m_results[file.index] = tools::hashFile(*file.path, file.key);
+        }
+    };
+}
+
+// ------------------------------------------------------------
+
+std::vector<std::string> tools::hashFiles(const std::vector<std::string>& paths)
+{
+    const auto& conf = Config::instance();
+    const auto& policy = hashing::IoPolicy::configured();
+
+    std::vector<std::string> results(paths.size());
+    std::vector<PendingFile> pending;
+
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        struct stat st;
+
+        if (stat(paths[i].c_str(), &st) != 0
+            || !S_ISREG(st.st_mode))
+        {
+            results[i] = tools::hashFile(paths[i]);
+            continue;
+        }
+
+        const auto key = StatCache::Key::fromStat(st);
+
+        // files for the batch: not cached, readable by us, not tree hashed,
+        // allowed in the page cache
+
+        if (!StatCache::instance().lookup(paths[i], key, results[i]))
+        {
+            if (hashing::loadXattrDigest(paths[i], key, results[i])) {
+                StatCache::instance().store(paths[i], key, StatCache::now(), results[i]);
+            }
+            else if (conf.hash_bin.empty()
+                && st.st_size > 0
+                && !policy.isUncached(st.st_size)
+                && !hashing::isTreeHashed(st.st_size))
+            {
+                pending.push_back(PendingFile{ i, &paths[i], key });
+            }
+            else {
+                results[i] = tools::hashFile(paths[i], key);
+            }
+        }
+    }
+
+    //
+
+    if (pending.size() > 1)
+    {
+        utils::IoUring ring(UringHasher::Depth * 2);
+
+        if (ring.isOpen()) {
+            UringHasher(ring, pending, results).run();
+        }
+        else {
+            utils::parallelFor(pending.size(),
+                               conf.hashThreads(),
+                               [&pending, &results] (std::size_t i)
+                               {
+                                   results[pending[i].index] = tools::hashFile(*pending[i].path, pending[i].key);
+                               });
+        }
+    }
+    else if (pending.size() == 1) {
+        results[pending[0].index] = tools::hashFile(*pending[0].path, pending[0].key);
+    }
+
+    return results;
+}
+
+std::vector<std::string> tools::calculateHashes(const std::vector<const HashCache*>& objects)
+{
+    std::vector<std::string> results(objects.size());
+    std::vector<std::string> paths;
+    std::vector<std::size_t> indexes;
+
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        std::string path = objects[i]->plainFile();
+
+        if (path.empty()) {
+            results[i] = objects[i]->calculateHash();
+        }
+        else {
+            paths.push_back(std::move(path));
+            indexes.push_back(i);
+        }
+    }
+
+    const auto digests = hashFiles(paths);
+
+    for (std::size_t i = 0; i < indexes.size(); ++i) {
+        results[indexes[i]] = digests[i];
+    }
+
+    return results;
+}
@@ -0,0 +1,30 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// forward declarations
+
+class HashCache;
+
+//
+
+namespace tools
+{
+    // Same digests as tools::hashFile() for each path, but files that have to
+    // be read are opened and read concurrently: through io_uring (up to 32
+    // files in flight, each hashed as its reads complete), or on hash_threads
+    // threads where io_uring is not available.
+
+    std::vector<std::string> hashFiles(const std::vector<std::string>& paths);
+
+    // calculateHash() of each object, with plain files batched as above
+
+    std::vector<std::string> calculateHashes(const std::vector<const HashCache*>& objects);
+}
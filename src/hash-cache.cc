@@ -6,6 +6,7 @@
 
 #include "hash-cache.hh"
 
+#include "cache-journal.hh"
 #include "master.hh"
 #include "script-tools.hh"
 #include "script.hh"
@@ -19,28 +20,96 @@ const std::string HashCache::TargetDoesNotExist = "<does-not-exist>";
 
 //
 
+namespace
+{
+    bool hasAlgorithm(const hashing::Digest& digest)
+    {
+        return !digest.empty()
+            && !digest.isDoesNotExist();
+    }
+}
+
+//
+
 HashCache::~HashCache() = default;
 
 void HashCache::storeHash(const std::string& hashSum)
 {
-    m_storedHashSum = hashSum;
+    m_stored = hashing::Digest::parse(hashSum);
+}
+
+void HashCache::storeHash(const hashing::Digest& digest)
+{
+    m_stored = digest;
+}
+
+std::string HashCache::probeHash() const
+{
+    return calculateHash();
+}
+
+std::string HashCache::plainFile() const
+{
+    return std::string();
+}
+
+bool HashCache::matchesHash(const std::string& hashSum, bool notExistOk) const
+{
+    return matchesHash(hashing::Digest::parse(hashSum), notExistOk);
 }
 
-bool HashCache::compareHash(const std::string& hashSum, bool notExistOk) const
+bool HashCache::matchesHash(const hashing::Digest& digest, bool notExistOk) const
 {
-    if (m_storedHashSum.empty()
+    if (m_stored.empty()
         && (!notExistOk
-            && m_storedHashSum == TargetDoesNotExist))
+            && m_stored.isDoesNotExist()))
     {
         return false;
     }
 
-    return m_storedHashSum == hashSum;
+    // digest made with another algorithm: nothing to compare against, so
+    // the new digest counts as a match (and becomes the baseline)
+
+    if (hasAlgorithm(m_stored)
+        && hasAlgorithm(digest)
+        && !m_stored.sameAlgorithm(digest))
+    {
+        return true;
+    }
+
+    // untagged legacy digests were read as sha256 by Digest::parse()
+
+    return m_stored == digest;
+}
+
+bool HashCache::compareHash(const std::string& hashSum, bool notExistOk)
+{
+    return compareHash(hashing::Digest::parse(hashSum), notExistOk);
+}
+
+bool HashCache::compareHash(const hashing::Digest& digest, bool notExistOk)
+{
+    if (!matchesHash(digest, notExistOk)) {
+        return false;
+    }
+
+    if (m_stored != digest
+        && !m_stored.sameAlgorithm(digest))
+    {
+        storeHash(digest);
+    }
+
+    return true;
 }
 
 std::string HashCache::getHashSum() const
 {
-    return m_storedHashSum;
+    return m_stored.str();
+}
+
+const hashing::Digest& HashCache::storedDigest() const
+{
+    return m_stored;
 }
 
 // ------------------------------------------------------------
@@ -62,7 +131,15 @@ public:
             && iter->second == type;
     }
 
-    void invalidate(Master& master,
+    void erase(const std::string& stepName)
+    {
+        m_marks.erase(stepName);
+    }
+
+    // returns whether any marks were erased
+
+    bool invalidate(Master& master,
+                    const std::string& artifactName,
                     const Link::Type type)
     {
         // sanity check
@@ -75,6 +152,8 @@ public:
 
         //
 
+        bool erased = false;
+
         for (auto iter = m_marks.begin();
              iter != m_marks.end();
              )
@@ -86,12 +165,16 @@ public:
                     && iter->second == Link::Type::Post))
             {
                 tools::undo(master, iter->first);
+                CacheJournal::instance().artifactUnmarked(artifactName, iter->first);
                 m_marks.erase(iter++);
+                erased = true;
             }
             else {
                 ++iter;
             }
         }
+
+        return erased;
     }
 
     std::vector<Artifact::Link> getAsVector() const
@@ -162,9 +245,27 @@ const std::string& Artifact::name() const
     return m_name;
 }
 
-void Artifact::recalculate()
+const std::string& Artifact::scope() const
+{
+    return m_scope;
+}
+
+bool Artifact::isCacheDirty() const
+{
+    return m_cacheDirty;
+}
+
+void Artifact::setCacheDirty(bool dirty)
 {
-    storeHash( calculateHash() );
+    m_cacheDirty = dirty;
+}
+
+void Artifact::recalculate(std::vector<std::string>* changedPaths)
+{
+    storeHash( rehash(changedPaths) );
+    m_cacheDirty = true;
+
+    CacheJournal::instance().artifactStored(*this);
 }
 
 void Artifact::completeStep(const std::string& stepName,
@@ -179,6 +280,8 @@ void Artifact::completeStep(const std::string& stepName,
     case Link::Type::Post:
         m_manager->touch(stepName,
                          linkType);
+        m_cacheDirty = true;
+        CacheJournal::instance().artifactMarked(m_name, stepName, linkType);
         break;
 
     default:
@@ -193,6 +296,12 @@ void Artifact::restoreMark(const std::string& stepName,
                      type);
 }
 
+void Artifact::dropMark(const std::string& stepName)
+{
+    m_manager->erase(stepName);
+    m_cacheDirty = true;
+}
+
 std::vector<Artifact::Link> Artifact::getMarks() const
 {
     return m_manager->getAsVector();
@@ -208,21 +317,34 @@ void Artifact::checkInvalidation(Master& master,
     {
         if (m_manager->stepFound(stepName, Link::Type::Aggregate))
         {
-            m_manager->invalidate(master,
-                                  Link::Type::Aggregate);
+            if (m_manager->invalidate(master,
+                                      m_name,
+                                      Link::Type::Aggregate))
+            {
+                m_cacheDirty = true;
+            }
 
             throw invalidate_scope(m_scope);
         }
-        else {
-            m_manager->invalidate(master,
-                                  Link::Type::Post);
+        else if (m_manager->invalidate(master,
+                                       m_name,
+                                       Link::Type::Post))
+        {
+            m_cacheDirty = true;
         }
     }
 
     // maybe rebuild *all* linked artifacts
 
-    if (!compareHash(calculateHash(), true))
+    const hashing::Digest baseline = storedDigest();
+
+    if (compareHash(calculateHash(), true))
     {
+        if (storedDigest() != baseline) {
+            m_cacheDirty = true;        // rebaselined
+        }
+    }
+    else {
         auto count = tools::rebuildArtifact(master, name());
 
         if (count > 0) {
@@ -231,6 +353,11 @@ void Artifact::checkInvalidation(Master& master,
     }
 }
 
+std::string Artifact::rehash(std::vector<std::string>* /*changedPaths*/)
+{
+    return calculateHash();
+}
+
 Artifact::Artifact(const std::string& name,
                    const std::string& scope)
     : m_name(name),
@@ -246,7 +373,7 @@ const std::string &Dependency::id() const
     return m_id;
 }
 
-bool Dependency::isUpToDate() const
+bool Dependency::isUpToDate()
 {
     return compareHash(calculateHash());
 }
@@ -6,7 +6,10 @@
 
 #pragma once
 
+#include "hash-digest.hh"
+
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -43,13 +46,31 @@ public:
 
     virtual std::string calculateHash() const = 0;
 
+    // digest as far as it can be known without reading file contents;
+    // empty if the stat data changed since the file was last hashed
+
+    virtual std::string probeHash() const;
+
+    // the file whose tools::hashFile() digest is this object's digest, if
+    // there is one, so that it can be hashed in a batch
+
+    virtual std::string plainFile() const;
+
+    // digests are kept in binary; the string forms are for the cache
+    // files and the command line
+
     void storeHash(const std::string& hashSum);
-    bool compareHash(const std::string& hashSum, bool notExistOk = false) const;
+    void storeHash(const hashing::Digest& digest);
+    bool matchesHash(const std::string& hashSum, bool notExistOk = false) const;
+    bool matchesHash(const hashing::Digest& digest, bool notExistOk = false) const;
+    bool compareHash(const std::string& hashSum, bool notExistOk = false);
+    bool compareHash(const hashing::Digest& digest, bool notExistOk = false);
 
     std::string getHashSum() const;
+    const hashing::Digest& storedDigest() const;
 
 private:
-    std::string m_storedHashSum;
+    hashing::Digest m_stored;
 };
 
 // -----
@@ -86,13 +107,21 @@ public:
     ~Artifact() override;
 
     const std::string& name() const;
+    const std::string& scope() const;
+
+    // set when the digest or the marks change, so that only changed
+    // artifacts are saved
+
+    bool isCacheDirty() const;
+    void setCacheDirty(bool dirty = true);
 
-    void recalculate();
+    void recalculate(std::vector<std::string>* changedPaths = nullptr);
     void completeStep(const std::string& stepName,
                       Link::Type linkType);
 
     void restoreMark(const std::string& stepName,
                      Link::Type type);
+    void dropMark(const std::string& stepName);
     std::vector<Link> getMarks() const;
 
     void checkInvalidation(Master& master,
@@ -103,10 +132,16 @@ protected:
     Artifact(const std::string& name,
              const std::string& scope);
 
+    // digest to store as the new baseline; artifacts that know their files
+    // report the ones that changed since the previous baseline
+
+    virtual std::string rehash(std::vector<std::string>* changedPaths);
+
 private:
     std::string m_name;
     std::string m_scope;
     std::unique_ptr<Manager> m_manager;
+    bool m_cacheDirty = false;
 };
 
 // -----
@@ -115,7 +150,7 @@ class Dependency : public HashCache {
 public:
     const std::string& id() const;
 
-    bool isUpToDate() const;
+    bool isUpToDate();
 
     virtual std::string type() const = 0;
 
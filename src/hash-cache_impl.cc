@@ -6,34 +6,131 @@
 
 #include "hash-cache_impl.hh"
 
+#include "config.hh"
+#include "hash-algo.hh"
+#include "hash-chunks.hh"
+#include "hash-content.hh"
 #include "master.hh"
 #include "hash-tools.hh"
-#include "utils/exec.hh"
-#include "utils/stream.hh"
+#include "utils/dir-walker.hh"
+#include "utils/path.hh"
 
-#include <fstream>
-#include <sstream>
+#include <cstdio>
 
 #include <unistd.h>
 
+namespace
+{
+    // per-artifact cache file cache_dir/<subdir>/<escaped name>; the
+    // directories are created as needed
+
+    std::string artifactCacheFile(const std::string& subdir, const std::string& artifactName)
+    {
+        const std::string& cacheDir = Config::instance().cache_dir;
+
+        utils::safeMkdir(cacheDir);
+        utils::safeMkdir(cacheDir + '/' + subdir);
+
+        std::string escaped;
+
+        for (const char c : artifactName)
+        {
+            switch (c) {
+            case '/': escaped += "%2F"; break;
+            case '%': escaped += "%25"; break;
+            default:  escaped += c;     break;
+            }
+        }
+
+        return cacheDir + '/' + subdir + '/' + escaped;
+    }
+
+    std::string hashFileBy(tools::Strategy strategy,
+                           const std::string& path,
+                           const hashing::IoPolicy& io)
+    {
+        switch (strategy) {
+        case tools::Strategy::Metadata: return tools::hashFileMetadata(path);
+        case tools::Strategy::Sampled:  return tools::hashFileSampled(path);
+        default:
+            break;
+        }
+
+        return tools::hashFile(path, io);
+    }
+}
+
+// ------------------------------------------------------------
+
 ArtifactFile::ArtifactFile(const std::string& name,
                            const std::string& scope,
-                           const std::string& path)
+                           const std::string& path,
+                           tools::Strategy strategy,
+                           std::unique_ptr<hashing::IoPolicy> io)
     : Artifact(name, scope),
-      m_path(path)
+      m_path(path),
+      m_strategy(strategy),
+      m_io(std::move( io ))
 {
 }
 
 std::string ArtifactFile::calculateHash() const
 {
-    std::ifstream ifs(m_path);
+    return hashFileBy(m_strategy,
+                      m_path,
+                      (m_io ? *m_io : hashing::IoPolicy::configured()));
+}
+
+std::string ArtifactFile::probeHash() const
+{
+    return (m_strategy == tools::Strategy::Content
+            ? tools::probeFile(m_path)
+            : calculateHash());
+}
+
+std::string ArtifactFile::plainFile() const
+{
+    // batches are read as configured
+
+    return (m_strategy == tools::Strategy::Content && !m_io
+            ? m_path
+            : std::string());
+}
+
+// -----
+
+ArtifactChunkedFile::ArtifactChunkedFile(const std::string& name,
+                                         const std::string& scope,
+                                         const std::string& path)
+    : Artifact(name, scope),
+      m_path(path)
+{
+}
 
-    if (ifs) {
-        return tools::hash(ifs);
+std::string ArtifactChunkedFile::calculateHash() const
+{
+    if (!m_loaded)
+    {
+        m_index.load(artifactCacheFile("chunks", name()));
+        m_loaded = true;
     }
-    else {
-        return TargetDoesNotExist;
+
+    if (m_index.update(m_path)) {
+        m_index.save(artifactCacheFile("chunks", name()));
     }
+
+    return m_index.digest();
+}
+
+std::string ArtifactChunkedFile::probeHash() const
+{
+    if (!m_loaded)
+    {
+        m_index.load(artifactCacheFile("chunks", name()));
+        m_loaded = true;
+    }
+
+    return m_index.probe(m_path);
 }
 
 // ------------------------------------------------------------
@@ -50,48 +147,128 @@ ArtifactDir::ArtifactDir(const std::string& name,
 
 std::string ArtifactDir::calculateHash() const
 {
-    using std::flush;
+    if (access(m_path.c_str(), X_OK) != 0) {
+        return TargetDoesNotExist;
+    }
+
+    // every directory is summed up in its own task from the lines
+    //
+    //     "f <size>\t<mtime>\t<name>\n"      mtime with nanoseconds
+    //     "d <sum>\t<name>\n"
     //
+    // with hash_algo even with hash_bin, like the metadata strategy, and
+    // tagged as such
+
+    const auto& algo = hashing::configured();
+
+    utils::DirWalker::Fold fold;
+
+    fold.fileLine = [] (const utils::DirWalker::Entry& entry, const std::string& name)
+        {
+            char line[64];
+
+            const int length = snprintf(line, sizeof(line), "f %llu\t%lld.%09lld\t",
+                                        static_cast<unsigned long long>(entry.size),
+                                        static_cast<long long>(entry.mtime / 1000000000),
+                                        static_cast<long long>(entry.mtime % 1000000000));
+
+            return std::string(line, length) + name + '\n';
+        };
+
+    fold.dirLine = [] (const std::string& name, const std::string& sum)
+        {
+            return "d " + sum + '\t' + name + '\n';
+        };
 
+    fold.digest = [&algo] (const std::string& lines)
+        {
+            auto hasher = algo.create();
+
+            hasher->update(lines.data(), lines.size());
+
+            return hasher->hexdigest();
+        };
+
+    const std::string sum = utils::DirWalker(m_exclude, Config::instance().hashThreads())
+        .fold(m_path, fold);
+
+    return (sum.empty()
+            ? TargetDoesNotExist
+            : hashing::tag(hashing::DirectoryTag, sum));
+}
+
+// ------------------------------------------------------------
+
+ArtifactContentDir::ArtifactContentDir(const std::string& name,
+                                       const std::string& scope,
+                                       const std::string& path,
+                                       std::vector<std::string>&& exclude,
+                                       std::unique_ptr<hashing::IoPolicy> io)
+    : Artifact(name, scope),
+      m_path(path),
+      m_exclude(std::move( exclude )),
+      m_io(std::move( io ))
+{
+}
+
+std::string ArtifactContentDir::calculateHash() const
+{
     if (access(m_path.c_str(), X_OK) != 0) {
         return TargetDoesNotExist;
     }
 
-    const std::string command = ({
-            std::ostringstream cmdOss;
-            utils::escape_bash cmdEsc(cmdOss);
+    hashing::ContentTree tree;
+
+    tree.build(m_path, m_exclude, io());
 
-            cmdOss << "find -L " << flush;
-            cmdEsc << m_path << flush;
+    return tree.digest();
+}
 
-            if (!m_exclude.empty())
-            {
-                auto iter = m_exclude.begin();
+std::string ArtifactContentDir::probeHash() const
+{
+    if (access(m_path.c_str(), X_OK) != 0) {
+        return TargetDoesNotExist;
+    }
 
-                cmdOss << " '(' -path " << flush;      // without -o
-                cmdEsc << *iter << flush;
-                cmdOss << " -prune" << flush;
+    return hashing::ContentTree::probe(m_path, m_exclude);
+}
 
-                for (++iter;
-                     iter != m_exclude.end();
-                     ++iter)
-                {
-                    cmdOss << " -o -path " << flush;       // with -o
-                    cmdEsc << *iter << flush;
-                    cmdOss << " -prune" << flush;
-                }
+std::string ArtifactContentDir::rehash(std::vector<std::string>* changedPaths)
+{
+    hashing::ContentTree tree;
 
-                cmdOss << " ')' -o" << flush;
-            }
+    if (access(m_path.c_str(), X_OK) == 0) {
+        tree.build(m_path, m_exclude, io());
+    }
 
-            cmdOss << " -type f -a -printf '%s\\t%t\\t%p\\n'";
+    const std::string fileName = treeFileName();
 
-            cmdOss.str();
-        });
+    if (changedPaths)
+    {
+        hashing::ContentTree baseline;
 
-    utils::Exec dirListingProcess(command);
+        baseline.load(fileName);
 
-    return tools::hash(dirListingProcess.read());
+        *changedPaths = hashing::ContentTree::diff(baseline, tree);
+    }
+
+    tree.save(fileName);
+
+    return (tree.digest().empty()
+            ? TargetDoesNotExist
+            : tree.digest());
+}
+
+const hashing::IoPolicy& ArtifactContentDir::io() const
+{
+    return (m_io
+            ? *m_io
+            : hashing::IoPolicy::configured());
+}
+
+std::string ArtifactContentDir::treeFileName() const
+{
+    return artifactCacheFile("content", name());
 }
 
 // ------------------------------------------------------------
@@ -108,6 +285,16 @@ std::string DependencyArtifact::calculateHash() const
     return m_master.artifact(m_id).calculateHash();
 }
 
+std::string DependencyArtifact::probeHash() const
+{
+    return m_master.artifact(m_id).probeHash();
+}
+
+std::string DependencyArtifact::plainFile() const
+{
+    return m_master.artifact(m_id).plainFile();
+}
+
 std::string DependencyArtifact::type() const
 {
     return "artifact";
@@ -135,22 +322,33 @@ std::string DependencyData::type() const
 // ------------------------------------------------------------
 
 DependencyFile::DependencyFile(const std::string& id,
-                               const std::string& path)
+                               const std::string& path,
+                               tools::Strategy strategy)
     : Dependency(id),
-      m_path(path)
+      m_path(path),
+      m_strategy(strategy)
 {
 }
 
 std::string DependencyFile::calculateHash() const
 {
-    std::ifstream ifs(m_path);
+    return hashFileBy(m_strategy,
+                      m_path,
+                      hashing::IoPolicy::configured());
+}
 
-    if (ifs) {
-        return tools::hash(ifs);
-    }
-    else {
-        return TargetDoesNotExist;
-    }
+std::string DependencyFile::probeHash() const
+{
+    return (m_strategy == tools::Strategy::Content
+            ? tools::probeFile(m_path)
+            : calculateHash());
+}
+
+std::string DependencyFile::plainFile() const
+{
+    return (m_strategy == tools::Strategy::Content
+            ? m_path
+            : std::string());
 }
 
 std::string DependencyFile::type() const
@@ -7,7 +7,11 @@
 #pragma once
 
 #include "hash-cache.hh"
+#include "hash-chunks.hh"
+#include "hash-io.hh"
+#include "hash-tools.hh"
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -21,12 +25,36 @@ class ArtifactFile : public Artifact {
 public:
     ArtifactFile(const std::string& name,
                  const std::string& scope,
-                 const std::string& path);
+                 const std::string& path,
+                 tools::Strategy strategy = tools::Strategy::Content,
+                 std::unique_ptr<hashing::IoPolicy> io = nullptr);      // null: as configured
 
     std::string calculateHash() const override;
+    std::string probeHash() const override;
+    std::string plainFile() const override;
 
 private:
     std::string m_path;
+    tools::Strategy m_strategy;
+    std::unique_ptr<hashing::IoPolicy> m_io;
+};
+
+// -----
+
+class ArtifactChunkedFile : public Artifact {
+public:
+    ArtifactChunkedFile(const std::string& name,
+                        const std::string& scope,
+                        const std::string& path);
+
+    std::string calculateHash() const override;
+    std::string probeHash() const override;
+
+private:
+    std::string m_path;
+
+    mutable hashing::ChunkIndex m_index;
+    mutable bool m_loaded = false;
 };
 
 // -----
@@ -45,6 +73,33 @@ private:
     std::vector<std::string> m_exclude;
 };
 
+// -----
+
+class ArtifactContentDir : public Artifact {
+public:
+    ArtifactContentDir(const std::string& name,
+                       const std::string& scope,
+                       const std::string& path,
+                       std::vector<std::string>&& exclude,
+                       std::unique_ptr<hashing::IoPolicy> io = nullptr);   // null: as configured
+
+    std::string calculateHash() const override;
+    std::string probeHash() const override;
+
+protected:
+    std::string rehash(std::vector<std::string>* changedPaths) override;
+
+private:
+    std::string m_path;
+    std::vector<std::string> m_exclude;
+    std::unique_ptr<hashing::IoPolicy> m_io;
+
+    //
+
+    const hashing::IoPolicy& io() const;
+    std::string treeFileName() const;
+};
+
 // ------------------------------------------------------------
 
 class DependencyArtifact : public Dependency {
@@ -53,6 +108,8 @@ public:
                        const std::string& artifact);
 
     std::string calculateHash() const override;
+    std::string probeHash() const override;
+    std::string plainFile() const override;
 
     std::string type() const override;
 
@@ -80,12 +137,16 @@ private:
 class DependencyFile : public Dependency {
 public:
     DependencyFile(const std::string& id,
-                   const std::string& path);
+                   const std::string& path,
+                   tools::Strategy strategy = tools::Strategy::Content);
 
     std::string calculateHash() const override;
+    std::string probeHash() const override;
+    std::string plainFile() const override;
 
     std::string type() const override;
 
 private:
     std::string m_path;
+    tools::Strategy m_strategy;
 };
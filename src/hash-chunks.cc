@@ -0,0 +1,316 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-chunks.hh"
+
+#include "hash-algo.hh"
+#include "hash-cache.hh"
+#include "utils/mapped-file.hh"
+#include "utils/path.hh"
+#include "utils/xxh3.hh"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    const std::string Magic = "swd-chunk-index 2";
+
+    enum : uint64_t {
+        MinChunk    = 8 * 1024,
+        NormalChunk = 64 * 1024,
+        MaxChunk    = 256 * 1024,
+    };
+
+    // normalized chunking: harder to cut before the normal size, easier after
+
+    const uint64_t MaskS = 0xFFFFC00000000000ull;      // 18 bits
+    const uint64_t MaskL = 0xFFFC000000000000ull;      // 14 bits
+
+    struct GearTable {
+        uint64_t value[256];
+
+        GearTable()
+        {
+            uint64_t state = 0x73776420676561ull;      // splitmix64
+
+            for (auto& v : value)
+            {
+                uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                v = z ^ (z >> 31);
+            }
+        }
+    };
+
+    const GearTable Gear;
+
+    // length of the chunk starting at 'data'
+
+    uint64_t cutPoint(const uint8_t* data, uint64_t size)
+    {
+        if (size <= MinChunk) {
+            return size;
+        }
+
+        const uint64_t normal = (size < NormalChunk ? size : uint64_t(NormalChunk));
+        const uint64_t limit = (size < MaxChunk ? size : uint64_t(MaxChunk));
+
+        uint64_t fp = 0;
+        uint64_t i = MinChunk;
+
+        for (; i < normal; ++i)
+        {
+            fp = (fp << 1) + Gear.value[data[i]];
+
+            if (!(fp & MaskS)) {
+                return i + 1;
+            }
+        }
+
+        for (; i < limit; ++i)
+        {
+            fp = (fp << 1) + Gear.value[data[i]];
+
+            if (!(fp & MaskL)) {
+                return i + 1;
+            }
+        }
+
+        return limit;
+    }
+
+    std::string hexDigest(const hashing::Algorithm& algo, const uint8_t* data, uint64_t size)
+    {
+        auto hasher = algo.create();
+
+        hasher->update(data, size);
+
+        return hasher->hexdigest();
+    }
+
+    // the bytes of [offset, offset + length), from the mapping or read
+
+    class Region {
+    public:
+        Region(int fd, const utils::MappedFile& mapped, uint64_t offset, uint64_t length)
+        {
+            if (mapped.isMapped()) {
+                m_data = mapped.data() + offset;
+                return;
+            }
+
+            m_buffer.resize(length);
+
+            for (uint64_t done = 0; done < length; )
+            {
+                const ssize_t got = pread(fd, m_buffer.data() + done, length - done, offset + done);
+
+                if (got <= 0) {
+                    throw std::runtime_error("file truncated while hashing");
+                }
+
+                done += got;
+            }
+
+            m_data = m_buffer.data();
+        }
+
+        const uint8_t* data() const { return m_data; }
+
+    private:
+        const uint8_t* m_data = nullptr;
+        std::vector<uint8_t> m_buffer;
+    };
+}
+
+// ------------------------------------------------------------
+
+std::string hashing::ChunkIndex::probe(const std::string& path) const
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0
+        || !S_ISREG(st.st_mode)
+        || st.st_size == 0)
+    {
+        return HashCache::TargetDoesNotExist;
+    }
+
+    return ((m_key == StatCache::Key::fromStat(st)
+             && StatCache::settled(m_key, m_hashedAt))
+            ? m_digest
+            : std::string());
+}
+
+bool hashing::ChunkIndex::update(const std::string& path)
+{
+    utils::OpenFile file(path, O_RDONLY);
+    struct stat st;
+
+    if (!file.isOpen()
+        || fstat(file.fd(), &st) != 0
+        || !S_ISREG(st.st_mode)
+        || st.st_size == 0)
+    {
+        const bool changed = !m_chunks.empty();
+
+        *this = ChunkIndex();
+        m_digest = HashCache::TargetDoesNotExist;
+
+        return changed;
+    }
+
+    const auto key = StatCache::Key::fromStat(st);
+
+    if (key == m_key
+        && StatCache::settled(m_key, m_hashedAt))
+    {
+        return false;
+    }
+
+    //
+
+    const auto& algo = hashing::configured();
+    const int64_t hashedAt = StatCache::now();
+    const uint64_t size = key.size;
+    const utils::MappedFile mapped(file.fd(), size);
+
+    // the whole file is run through XXH3-128 once; in place growth keeps
+    // the chunks before the last one only if the indexed part is unchanged
+
+    utils::Xxh3_128 contents;
+    uint64_t checked = 0;
+    std::size_t keep = 0;
+
+    if (!m_chunks.empty()
+        && key.dev == m_key.dev
+        && key.ino == m_key.ino
+        && key.size > m_key.size)
+    {
+        const Region region(file.fd(), mapped, 0, m_key.size);
+
+        contents.update(region.data(), m_key.size);
+        checked = m_key.size;
+
+        if (contents.hexdigest() == m_contents) {
+            keep = m_chunks.size() - 1;
+        }
+    }
+
+    {
+        const Region region(file.fd(), mapped, checked, size - checked);
+
+        contents.update(region.data(), size - checked);
+    }
+
+    m_chunks.resize(keep);
+
+    //
+
+    const uint64_t start = (keep > 0
+                            ? m_chunks.back().offset + m_chunks.back().length
+                            : 0);
+
+    const Region region(file.fd(), mapped, start, size - start);
+
+    for (uint64_t offset = start; offset < size; )
+    {
+        const uint8_t* data = region.data() + (offset - start);
+        const uint64_t length = cutPoint(data, size - offset);
+
+        m_chunks.push_back(Chunk{ offset, length, hexDigest(algo, data, length) });
+        offset += length;
+    }
+
+    //
+
+    auto hasher = algo.create();
+
+    for (const auto& chunk : m_chunks)
+    {
+        hasher->update(chunk.digest.data(), chunk.digest.size());
+        hasher->update("\n", 1);
+    }
+
+    m_key = key;
+    m_hashedAt = hashedAt;
+    m_digest = hashing::tag(algo.name, hasher->hexdigest());
+    m_contents = contents.hexdigest();
+
+    return true;
+}
+
+void hashing::ChunkIndex::load(const std::string& fileName)
+{
+    *this = ChunkIndex();
+
+    std::ifstream ifs(fileName);
+    std::string line;
+
+    if (!getline(ifs, line)
+        || line != Magic
+        || !getline(ifs, line))
+    {
+        return;
+    }
+
+    std::istringstream iss(line);
+    ChunkIndex index;
+
+    if (!(iss >> index.m_key.dev >> index.m_key.ino >> index.m_key.size
+          >> index.m_key.mtime >> index.m_key.ctime
+          >> index.m_hashedAt >> index.m_digest >> index.m_contents)
+        || hashing::algorithmOf(index.m_digest) != hashing::configured().name)
+    {
+        return;     // made with another algorithm: start over
+    }
+
+    Chunk chunk;
+
+    while (ifs >> chunk.offset >> chunk.length >> chunk.digest) {
+        index.m_chunks.push_back(chunk);
+    }
+
+    *this = std::move(index);
+}
+
+void hashing::ChunkIndex::save(const std::string& fileName) const
+{
+    const std::string tmpName = fileName + ".tmp";
+
+    std::ofstream ofs(tmpName);
+
+    if (!ofs) {
+        throw std::runtime_error("failed to open chunk index file: " + tmpName);
+    }
+
+    ofs << Magic << '\n'
+        << m_key.dev << ' ' << m_key.ino << ' ' << m_key.size << ' '
+        << m_key.mtime << ' ' << m_key.ctime << ' '
+        << m_hashedAt << ' ' << m_digest << ' ' << m_contents << '\n';
+
+    for (const auto& chunk : m_chunks) {
+        ofs << chunk.offset << ' ' << chunk.length << ' ' << chunk.digest << '\n';
+    }
+
+    if (!(ofs << std::flush)) {
+        throw std::runtime_error("failed to save chunk index: " + fileName);
+    }
+
+    if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + fileName + "'");
+    }
+}
@@ -0,0 +1,61 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include "stat-cache.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hashing
+{
+    // Content-defined chunk index of a file that mostly grows (logs,
+    // archives, images). The file is cut into chunks with a FastCDC gear
+    // hash (8 KiB .. 256 KiB, 64 KiB on average), every chunk is hashed
+    // with the configured algorithm, and the file digest is the hash of
+    //
+    //     <hex digest of chunk 0> "\n" <hex digest of chunk 1> "\n" ...
+    //
+    // When the file has grown in place (same device and inode), the stored
+    // chunks before the last one are kept and only the data from the start
+    // of the last chunk on is chunked and hashed. The kept part is checked
+    // first against an XXH3-128 digest of the file as indexed, which reads
+    // it but at a fraction of the cost of rechunking; an edit anywhere in
+    // it rechunks the whole file, as does any other change.
+
+    class ChunkIndex {
+    public:
+        struct Chunk {
+            uint64_t offset;
+            uint64_t length;
+            std::string digest;     // hex
+        };
+
+        //
+
+        const std::string& digest() const { return m_digest; }
+
+        // digest from stat data alone, empty if the file must be read
+
+        std::string probe(const std::string& path) const;
+
+        // brings the index up to date; returns false if nothing changed
+
+        bool update(const std::string& path);
+
+        void load(const std::string& fileName);
+        void save(const std::string& fileName) const;
+
+    private:
+        StatCache::Key m_key = {};
+        int64_t m_hashedAt = 0;
+        std::string m_digest;
+        std::string m_contents;     // XXH3-128 of the file as indexed, hex
+        std::vector<Chunk> m_chunks;
+    };
+}
@@ -0,0 +1,307 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-content.hh"
+
+#include "config.hh"
+#include "hash-algo.hh"
+#include "hash-cache.hh"
+#include "hash-tools.hh"
+#include "stat-cache.hh"
+#include "utils/dir-walker.hh"
+#include "utils/parallel.hh"
+
+#include <fstream>
+#include <stdexcept>
+
+//
+
+namespace
+{
+    const std::string Magic = "swd-content-tree 1";
+
+    struct File {
+        std::string path;
+        StatCache::Key key;
+    };
+
+    // folds the sorted depth-first file list into directory nodes
+
+    class Folder {
+    public:
+        Folder()
+            : m_algo(hashing::configured()),
+              m_tag(Config::instance().hash_bin.empty()
+                    ? m_algo.name
+                    : hashing::HashBinTag)
+        {
+            m_stack.push_back(Level());
+        }
+
+        void add(const std::string& relativePath, const std::string& digest)
+        {
+            std::vector<std::string> parts;
+
+            for (std::size_t begin = 0;;)
+            {
+                const std::size_t end = relativePath.find('/', begin);
+
+                parts.push_back(relativePath.substr(begin, end - begin));
+
+                if (end == std::string::npos) {
+                    break;
+                }
+
+                begin = end + 1;
+            }
+
+            // close directories that the path has left, open the new ones
+
+            const std::size_t dirs = parts.size() - 1;
+            std::size_t common = 0;
+
+            while (common + 1 < m_stack.size()
+                   && common < dirs
+                   && m_stack[common + 1].name == parts[common])
+            {
+                ++common;
+            }
+
+            while (m_stack.size() > common + 1) {
+                close();
+            }
+
+            for (std::size_t i = common; i < dirs; ++i) {
+                m_stack.push_back(Level{ parts[i], std::string() });
+            }
+
+            m_stack.back().text += "f " + digest + ' ' + parts.back() + '\n';
+        }
+
+        std::string finish()
+        {
+            while (m_stack.size() > 1) {
+                close();
+            }
+
+            return nodeDigest(m_stack.back().text);
+        }
+
+    private:
+        struct Level {
+            std::string name;
+            std::string text;
+        };
+
+        const hashing::Algorithm& m_algo;
+        const std::string m_tag;            // file digests made by hash_bin tag the tree too
+        std::vector<Level> m_stack;
+
+        //
+
+        std::string nodeDigest(const std::string& text) const
+        {
+            auto hasher = m_algo.create();
+
+            hasher->update(text.data(), text.size());
+
+            return hashing::tag(m_tag, hasher->hexdigest());
+        }
+
+        void close()
+        {
+            const std::string digest = nodeDigest(m_stack.back().text);
+            const std::string name = m_stack.back().name;
+
+            m_stack.pop_back();
+            m_stack.back().text += "d " + digest + ' ' + name + '\n';
+        }
+    };
+
+    std::vector<File> listFiles(const std::string& root,
+                                const std::vector<std::string>& exclude,
+                                unsigned int threads)
+    {
+        std::vector<File> files;
+
+        utils::DirWalker(exclude, threads)
+            .walk(root,
+                  [&files] (const utils::DirWalker::Entry& entry)
+                  {
+                      files.push_back(File{ entry.path,
+                                            StatCache::Key{ entry.dev, entry.ino, entry.size, entry.mtime, entry.ctime } });
+                  });
+
+        return files;
+    }
+
+    // tree digest of the sorted 'files' under 'root'
+
+    std::string fold(const std::string& root,
+                     const std::vector<File>& files,
+                     const std::vector<std::string>& digests)
+    {
+        if (files.empty()) {
+            return HashCache::TargetDoesNotExist;
+        }
+
+        const std::size_t prefix = ((root.empty() || root.back() == '/')
+                                    ? root.size()
+                                    : root.size() + 1);
+
+        Folder folder;
+
+        for (std::size_t i = 0; i < files.size(); ++i)
+        {
+            const std::string& path = files[i].path;
+
+            folder.add(path.size() > prefix ? path.substr(prefix) : std::string(),
+                       digests[i]);
+        }
+
+        return folder.finish();
+    }
+}
+
+// ------------------------------------------------------------
+
+void hashing::ContentTree::build(const std::string& root,
+                                 const std::vector<std::string>& exclude,
+                                 const IoPolicy& policy)
+{
+    const unsigned int threads = Config::instance().hashThreads();
+    const std::vector<File> files = listFiles(root, exclude, threads);
+
+    // contents of changed files are read in parallel
+
+    std::vector<std::string> digests(files.size());
+
+    utils::parallelFor(files.size(),
+                       threads,
+                       [&files, &policy, &digests] (std::size_t i)
+                       {
+                           digests[i] = tools::hashFile(files[i].path, files[i].key, policy);
+                       });
+
+    //
+
+    m_files.clear();
+
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        m_files.emplace_hint(m_files.end(), files[i].path, digests[i]);
+    }
+
+    m_digest = fold(root, files, digests);
+}
+
+std::string hashing::ContentTree::probe(const std::string& root,
+                                        const std::vector<std::string>& exclude)
+{
+    const std::vector<File> files = listFiles(root, exclude, Config::instance().hashThreads());
+    const StatCache& statCache = StatCache::instance();
+
+    std::vector<std::string> digests(files.size());
+
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        if (!statCache.lookup(files[i].path, files[i].key, digests[i])) {
+            return std::string();
+        }
+    }
+
+    return fold(root, files, digests);
+}
+
+void hashing::ContentTree::load(const std::string& fileName)
+{
+    m_digest.clear();
+    m_files.clear();
+
+    std::ifstream ifs(fileName);
+    std::string line;
+
+    if (!getline(ifs, line)
+        || line != Magic
+        || !getline(ifs, m_digest))
+    {
+        m_digest.clear();
+        return;
+    }
+
+    while (getline(ifs, line))
+    {
+        const std::size_t space = line.find(' ');
+
+        if (space != std::string::npos) {
+            m_files.emplace_hint(m_files.end(), line.substr(space + 1), line.substr(0, space));
+        }
+    }
+}
+
+void hashing::ContentTree::save(const std::string& fileName) const
+{
+    const std::string tmpName = fileName + ".tmp";
+
+    std::ofstream ofs(tmpName);
+
+    if (!ofs) {
+        throw std::runtime_error("failed to open content tree file: " + tmpName);
+    }
+
+    ofs << Magic << '\n'
+        << m_digest << '\n';
+
+    for (const auto& pair : m_files)
+    {
+        if (pair.first.find('\n') == std::string::npos) {
+            ofs << pair.second << ' ' << pair.first << '\n';
+        }
+    }
+
+    if (!(ofs << std::flush)) {
+        throw std::runtime_error("failed to save content tree: " + fileName);
+    }
+
+    if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + fileName + "'");
+    }
+}
+
+std::vector<std::string> hashing::ContentTree::diff(const ContentTree& before,
+                                                     const ContentTree& after)
+{
+    std::vector<std::string> changes;
+
+    auto b = before.m_files.begin();
+    auto a = after.m_files.begin();
+
+    while (b != before.m_files.end()
+           || a != after.m_files.end())
+    {
+        if (a == after.m_files.end()
+            || (b != before.m_files.end() && b->first < a->first))
+        {
+            changes.push_back("D " + b->first);
+            ++b;
+        }
+        else if (b == before.m_files.end()
+                 || a->first < b->first)
+        {
+            changes.push_back("A " + a->first);
+            ++a;
+        }
+        else {
+            if (a->second != b->second) {
+                changes.push_back("M " + a->first);
+            }
+
+            ++a;
+            ++b;
+        }
+    }
+
+    return changes;
+}
@@ -0,0 +1,62 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include "hash-io.hh"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hashing
+{
+    // Content digest of a directory, as a Merkle tree: every directory node
+    // is the hash of its sorted entries,
+    //
+    //     "f " <file digest> " " <name> "\n"
+    //     "d " <node digest> " " <name> "\n"
+    //
+    // so the digest does not depend on where the tree is or on timestamps.
+    // File digests come from tools::hashFile(), which skips files whose stat
+    // data is unchanged, so a rebuild costs one stat per file and a read of
+    // each changed file. Directory nodes are not kept between runs: a
+    // directory's stat data does not change when a file in it is rewritten,
+    // so it cannot vouch for its subtree, and every node is folded again
+    // from its entries.
+
+    class ContentTree {
+    public:
+        using files_t = std::map<std::string, std::string>;     // path -> digest
+
+        //
+
+        const std::string& digest() const { return m_digest; }
+        const files_t& files() const { return m_files; }
+
+        void build(const std::string& root,
+                   const std::vector<std::string>& exclude,
+                   const IoPolicy& policy = IoPolicy::configured());
+
+        // digest from stat data alone, empty if a file must be read
+
+        static std::string probe(const std::string& root,
+                                 const std::vector<std::string>& exclude);
+
+        void load(const std::string& fileName);
+        void save(const std::string& fileName) const;
+
+        // "A <path>", "D <path>" or "M <path>" for each added, deleted or
+        // modified file, in path order
+
+        static std::vector<std::string> diff(const ContentTree& before,
+                                             const ContentTree& after);
+
+    private:
+        std::string m_digest;
+        files_t m_files;
+    };
+}
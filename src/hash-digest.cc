@@ -0,0 +1,199 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-digest.hh"
+
+#include "hash-algo.hh"
+#include "hash-cache.hh"
+#include "utils/string.hh"
+
+#include <mutex>
+#include <unordered_set>
+
+//
+
+namespace
+{
+    enum : uint8_t {
+        Empty        = 0,
+        DoesNotExist = 1,
+        Text         = 2,
+        FirstNamed   = 3,
+    };
+
+    // algorithms known by number; anything else is kept as text
+
+    const std::string s_names[] = {
+        "blake3",
+        "dir2",
+        "hash_bin",
+        "metadata",
+        "sampled",
+        "sha256",
+        "sha256-tree4m",
+        "xxh3-128",
+        "xxh3-128-tree4m",
+    };
+
+    enum { NameCount = sizeof(s_names) / sizeof(s_names[0]) };
+
+    int nameIndex(const std::string& name)
+    {
+        for (int i = 0; i < NameCount; ++i)
+        {
+            if (s_names[i] == name) {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    // texts are never removed, so their addresses stay valid
+
+    const std::string* intern(const std::string& text)
+    {
+        static std::mutex s_mutex;
+        static std::unordered_set<std::string> s_pool;
+
+        std::lock_guard<std::mutex> lock(s_mutex);
+
+        return &*s_pool.insert(text).first;
+    }
+}
+
+// ------------------------------------------------------------
+
+hashing::Digest hashing::Digest::parse(const std::string& text)
+{
+    Digest digest;
+
+    if (text.empty()) {
+        return digest;
+    }
+    else if (text == HashCache::TargetDoesNotExist) {
+        return doesNotExist();
+    }
+
+    const std::string::size_type colon = text.find(':');
+    const int index = nameIndex(algorithmOf(text));
+
+    const char* hex = (colon == std::string::npos ? text.data() : text.data() + colon + 1);
+    const std::size_t length = text.size() - (hex - text.data());
+
+    if (index >= 0
+        && length > 0
+        && length <= 2 * MaxSize
+        && length % 2 == 0
+        && utils::fromHex(hex, length, digest.m_bytes, length / 2))
+    {
+        digest.m_algorithm = uint8_t(FirstNamed + index);
+        digest.m_size = uint8_t(length / 2);
+    }
+    else {
+        const std::string* pooled = intern(text);
+
+        digest.m_algorithm = Text;
+        std::memcpy(digest.m_bytes, &pooled, sizeof(pooled));
+    }
+
+    return digest;
+}
+
+hashing::Digest hashing::Digest::fromBinary(const std::string& algorithm, const uint8_t* bytes, std::size_t size)
+{
+    const int index = nameIndex(algorithm);
+
+    if (index < 0
+        || size == 0
+        || size > MaxSize)
+    {
+        return parse(tag(algorithm, utils::toHex(bytes, size)));
+    }
+
+    Digest digest;
+
+    digest.m_algorithm = uint8_t(FirstNamed + index);
+    digest.m_size = uint8_t(size);
+    std::memcpy(digest.m_bytes, bytes, size);
+
+    return digest;
+}
+
+hashing::Digest hashing::Digest::doesNotExist()
+{
+    Digest digest;
+
+    digest.m_algorithm = DoesNotExist;
+
+    return digest;
+}
+
+std::string hashing::Digest::str() const
+{
+    switch (m_algorithm) {
+    case Empty:        return std::string();
+    case DoesNotExist: return HashCache::TargetDoesNotExist;
+    case Text:         return *text();
+    }
+
+    const std::string& name = s_names[m_algorithm - FirstNamed];
+    std::string result(name.size() + 1 + 2 * m_size, ':');
+
+    name.copy(&result[0], name.size());
+    utils::toHex(m_bytes, m_size, &result[name.size() + 1]);
+
+    return result;
+}
+
+bool hashing::Digest::empty() const
+{
+    return m_algorithm == Empty;
+}
+
+bool hashing::Digest::isDoesNotExist() const
+{
+    return m_algorithm == DoesNotExist;
+}
+
+bool hashing::Digest::isBinary() const
+{
+    return m_algorithm >= FirstNamed;
+}
+
+std::string hashing::Digest::algorithm() const
+{
+    switch (m_algorithm) {
+    case Empty:
+    case DoesNotExist:
+        return std::string();
+
+    case Text:
+        return algorithmOf(*text());
+    }
+
+    return s_names[m_algorithm - FirstNamed];
+}
+
+bool hashing::Digest::sameAlgorithm(const Digest& other) const
+{
+    if (m_algorithm >= FirstNamed
+        && other.m_algorithm >= FirstNamed)
+    {
+        return m_algorithm == other.m_algorithm;
+    }
+
+    return algorithm() == other.algorithm();
+}
+
+const std::string* hashing::Digest::text() const
+{
+    const std::string* pooled;
+
+    std::memcpy(&pooled, m_bytes, sizeof(pooled));
+
+    return pooled;
+}
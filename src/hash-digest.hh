@@ -0,0 +1,76 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace hashing
+{
+    // Stored digest in binary: the algorithm as a small number and up to
+    // 32 bytes of digest, so that a HashCache holds no heap strings and two
+    // digests compare with a couple of word compares.
+    //
+    // parse() and str() convert from and to the "<algorithm>:<hex>" form
+    // used in the cache files and on the command line. Digests that do not
+    // fit (unknown algorithm, hash_bin output that is longer or not
+    // lowercase hex) keep their text in a process-wide pool and compare by
+    // pool entry.
+
+    class Digest {
+    public:
+        enum { MaxSize = 32 };
+
+        Digest() = default;             // nothing stored
+
+        static Digest parse(const std::string& text);
+        static Digest doesNotExist();
+        static Digest fromBinary(const std::string& algorithm, const uint8_t* bytes, std::size_t size);
+
+        std::string str() const;
+
+        bool empty() const;
+        bool isDoesNotExist() const;
+
+        // digest bytes, for digests kept in binary; the others exist only
+        // as str()
+
+        bool isBinary() const;
+        const uint8_t* bytes() const { return m_bytes; }
+        std::size_t size() const { return m_size; }
+
+        // "" for empty and nonexistent targets
+
+        std::string algorithm() const;
+        bool sameAlgorithm(const Digest& other) const;
+
+        //
+
+        bool operator== (const Digest& other) const
+        {
+            return m_algorithm == other.m_algorithm
+                && m_size == other.m_size
+                && std::memcmp(m_bytes, other.m_bytes, MaxSize) == 0;
+        }
+
+        bool operator!= (const Digest& other) const
+        {
+            return !(*this == other);
+        }
+
+    private:
+        uint8_t m_algorithm = 0;        // index to the algorithm names
+        uint8_t m_size = 0;
+        uint8_t m_bytes[MaxSize] = {};
+
+        //
+
+        const std::string* text() const;
+    };
+}
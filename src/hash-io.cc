@@ -0,0 +1,65 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-io.hh"
+
+#include "config.hh"
+#include "utils/throttle.hh"
+
+#include <stdexcept>
+#include <string>
+
+bool hashing::IoPolicy::isUncached(uint64_t size) const
+{
+    return (uncachedSize > 0
+            && size >= uncachedSize);
+}
+
+void hashing::IoPolicy::throttle(uint64_t bytes) const
+{
+    if (m_throttle) {
+        m_throttle->consume(bytes);
+    }
+}
+
+void hashing::IoPolicy::setBandwidth(uint64_t bytesPerSecond)
+{
+    bandwidth = bytesPerSecond;
+    m_throttle = (bytesPerSecond > 0
+                  ? std::make_shared<utils::Throttle>(bytesPerSecond)
+                  : nullptr);
+}
+
+hashing::IoPolicy::Uncached hashing::IoPolicy::parseUncachedMode(const std::string& mode)
+{
+    if (mode == "dontneed") {
+        return Uncached::DontNeed;
+    }
+    else if (mode == "direct") {
+        return Uncached::Direct;
+    }
+    else {
+        throw std::runtime_error("invalid uncached mode '" + mode + "' (expected 'dontneed' or 'direct')");
+    }
+}
+
+const hashing::IoPolicy& hashing::IoPolicy::configured()
+{
+    static const IoPolicy s_policy = [] ()
+        {
+            const auto& conf = Config::instance();
+            IoPolicy policy;
+
+            policy.readahead = conf.hash_readahead;
+            policy.uncachedSize = conf.hash_uncached_size;
+            policy.uncachedMode = parseUncachedMode(conf.hash_uncached_mode);
+            policy.setBandwidth(conf.hash_bandwidth);
+
+            return policy;
+        }();
+
+    return s_policy;
+}
@@ -0,0 +1,59 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace utils
+{
+    class Throttle;
+}
+
+namespace hashing
+{
+    // How files are read for hashing, so that hashing big artifacts does not
+    // push the working set of running steps out of the page cache.
+    //
+    //   readahead      posix_fadvise(WILLNEED) files as they are queued
+    //   uncachedSize   files at least this big (0: none) are streamed past
+    //                  the page cache, by dropping each block once read
+    //                  (DontNeed) or with O_DIRECT (Direct)
+    //   bandwidth      bytes per second for all reading under this policy
+    //                  (0: unlimited)
+
+    struct IoPolicy {
+        enum class Uncached {
+            DontNeed,
+            Direct,
+        };
+
+        bool readahead = false;
+        uint64_t uncachedSize = 0;
+        Uncached uncachedMode = Uncached::DontNeed;
+        uint64_t bandwidth = 0;
+
+        //
+
+        bool isUncached(uint64_t size) const;
+
+        void throttle(uint64_t bytes) const;
+
+        // the throttle is shared by copies of the policy; setting the
+        // bandwidth starts a budget of its own
+
+        void setBandwidth(uint64_t bytesPerSecond);
+
+        static Uncached parseUncachedMode(const std::string& mode);
+
+        static const IoPolicy& configured();
+
+    private:
+        std::shared_ptr<utils::Throttle> m_throttle;
+    };
+}
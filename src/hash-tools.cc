@@ -7,46 +7,217 @@
 #include "hash-tools.hh"
 
 #include "config.hh"
+#include "hash-algo.hh"
+#include "hash-batch.hh"
 #include "hash-cache.hh"
+#include "hash-tree.hh"
+#include "hash-xattr.hh"
 #include "master.hh"
+#include "stat-cache.hh"
 #include "utils/ansi.hh"
 #include "utils/exec.hh"
+#include "utils/mapped-file.hh"
+#include "utils/path.hh"
 #include "utils/stream.hh"
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <functional>
 #include <iomanip>
 #include <istream>
+#include <mutex>
 #include <ostream>
+#include <streambuf>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 //
 
 namespace
 {
-    std::string calculate_hash(std::function<void(std::ostream&)> feedInput)
+    std::string checked_hash_bin(std::string hashSum)
     {
         const auto& conf = Config::instance();
 
-        utils::Exec hashCmd(conf.hash_bin,
-                            utils::Exec::Flag::NoShell);
+        if (hashSum.size() != conf.hashsum_size) {
+            throw std::runtime_error{"Configured hash_bin (" + conf.hash_bin+ ") produces invalid hashes"};
+        }
 
-        feedInput(hashCmd.write());
+        return hashing::tag(hashing::HashBinTag, hashSum);
+    }
+
+    std::string finish_hash_bin(utils::Exec& hashCmd)
+    {
         hashCmd.close_write();
 
         //
 
         std::string hashSum;
 
-        if (!getline(hashCmd.read(), hashSum, ' ')
-            || hashSum.size() != conf.hashsum_size
-            )
+        getline(hashCmd.read(), hashSum, ' ');
+
+        return checked_hash_bin(hashSum);
+    }
+
+    // -----
+
+    // hash_bin_mode coprocess: hash_bin is started once and fed every input
+    // over the same pipe. Framing, swd -> hash_bin:
+    //
+    //     "<length>\n" <length bytes>     repeated, length > 0
+    //     "0\n"                           end of input
+    //
+    // and hash_bin -> swd, once per input:
+    //
+    //     <hash> [ " " anything ] "\n"
+    //
+    // test/include/hash_coproc.py is a reference implementation.
+
+    class FrameBuf : public std::streambuf {
+    public:
+        FrameBuf(std::ostream& out)
+            : m_out(out)
         {
-            throw std::runtime_error{"Configured hash_bin (" + conf.hash_bin+ ") produces invalid hashes"};
+            setp(m_buffer, m_buffer + BufferSize);
         }
 
-        hashSum.erase(conf.hashsum_size);
+    protected:
+        int_type overflow(int_type c) override
+        {
+            sync();
 
-        return hashSum;
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char* data, std::streamsize size) override
+        {
+            if (size < BufferSize) {
+                return std::streambuf::xsputn(data, size);
+            }
+
+            sync();
+            frame(data, size);
+
+            return size;
+        }
+
+        int sync() override
+        {
+            frame(pbase(), pptr() - pbase());
+            setp(m_buffer, m_buffer + BufferSize);
+
+            return (m_out ? 0 : -1);
+        }
+
+    private:
+        enum { BufferSize = 64 * 1024 };
+
+        std::ostream& m_out;
+        char m_buffer[BufferSize];
+
+        //
+
+        void frame(const char* data, std::streamsize size)
+        {
+            if (size > 0) {
+                m_out << size << '\n';
+                m_out.write(data, size);
+            }
+        }
+    };
+
+    class HashCoprocess {
+    public:
+        std::mutex mutex;
+
+        //
+
+        std::ostream& input() { return m_input; }
+
+        std::string finish()
+        {
+            m_input.flush();
+            m_exec.write() << "0\n" << std::flush;
+
+            std::string line;
+
+            if (!m_exec.write()
+                || !getline(m_exec.read(), line))
+            {
+                throw std::runtime_error{"Configured hash_bin (" + Config::instance().hash_bin + ") exited"};
+            }
+
+            return checked_hash_bin(line.substr(0, line.find(' ')));
+        }
+
+        static HashCoprocess& instance()
+        {
+            static HashCoprocess s_coprocess;
+            return s_coprocess;
+        }
+
+    private:
+        utils::Exec m_exec;
+        FrameBuf m_frames;
+        std::ostream m_input;
+
+        //
+
+        HashCoprocess()
+            : m_exec(Config::instance().hash_bin,
+                     utils::Exec::Flag::NoShell),
+              m_frames(m_exec.write()),
+              m_input(&m_frames) {}
+
+        ~HashCoprocess()
+        {
+            m_exec.close_write();
+            m_exec.wait();
+        }
+    };
+
+    bool useCoprocess()
+    {
+        return Config::instance().hash_bin_mode == "coprocess";
+    }
+
+    // -----
+
+    std::string calculate_hash_bin(std::function<void(std::ostream&)> feedInput)
+    {
+        if (useCoprocess())
+        {
+            auto& coprocess = HashCoprocess::instance();
+            std::lock_guard<std::mutex> lock(coprocess.mutex);
+
+            feedInput(coprocess.input());
+
+            return coprocess.finish();
+        }
+
+        utils::Exec hashCmd(Config::instance().hash_bin,
+                            utils::Exec::Flag::NoShell);
+
+        feedInput(hashCmd.write());
+
+        return finish_hash_bin(hashCmd);
+    }
+
+    bool useHashBin()
+    {
+        return !Config::instance().hash_bin.empty();
     }
+
+    std::string hashFileContents(const std::string& path, const hashing::IoPolicy& policy);
 }
 
 //
@@ -56,11 +227,19 @@ std::string tools::hash(const std::string& input)
     if (input.empty()) {
         return HashCache::TargetDoesNotExist;
     }
+    else if (useHashBin()) {
+        return calculate_hash_bin([&input] (std::ostream& out)
+                                  {
+                                      out << input;
+                                  });
+    }
     else {
-        return calculate_hash([&input] (std::ostream& out)
-                              {
-                                  out << input;
-                              });
+        const auto& algo = hashing::configured();
+        auto hasher = algo.create();
+
+        hasher->update(input.data(), input.size());
+
+        return hashing::tag(algo.name, hasher->hexdigest());
     }
 }
 
@@ -72,32 +251,434 @@ std::string tools::hash(std::istream& input)
         return HashCache::TargetDoesNotExist;
     }
 
-    return calculate_hash([&input, firstByte] (std::ostream& out)
-                          {
-                              out.put(firstByte);
-                              out << input.rdbuf();
-                          });
+    if (useHashBin()) {
+        return calculate_hash_bin([&input, firstByte] (std::ostream& out)
+                                  {
+                                      out.put(firstByte);
+                                      out << input.rdbuf();
+                                  });
+    }
+
+    //
+
+    enum { BufferSize = 64 * 1024 };
+    char buffer[BufferSize];
+
+    const auto& algo = hashing::configured();
+    auto hasher = algo.create();
+
+    hasher->update(&firstByte, 1);
+
+    while (input.read(buffer, BufferSize)
+           || input.gcount() > 0)
+    {
+        hasher->update(buffer, input.gcount());
+    }
+
+    return hashing::tag(algo.name, hasher->hexdigest());
+}
+
+tools::Digester::Digester() = default;
+
+tools::Digester::~Digester()
+{
+    // an unfinished input would leave the coprocess mid-frame
+
+    if (m_coprocessLock.owns_lock())
+    {
+        try {
+            HashCoprocess::instance().finish();
+        }
+        catch (...) {
+        }
+    }
+}
+
+void tools::Digester::update(const char* data, std::size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    if (!m_hasher
+        && !m_hashBinInput)
+    {
+        if (!useHashBin()) {
+            m_hasher = hashing::configured().create();
+        }
+        else if (useCoprocess())
+        {
+            auto& coprocess = HashCoprocess::instance();
+
+            m_coprocessLock = std::unique_lock<std::mutex>(coprocess.mutex);
+            m_hashBinInput = &coprocess.input();
+        }
+        else {
+            m_hashBin = std::make_unique<utils::Exec>(Config::instance().hash_bin,
+                                                      utils::Exec::Flag::NoShell);
+            m_hashBinInput = &m_hashBin->write();
+        }
+    }
+
+    if (m_hashBinInput) {
+        m_hashBinInput->write(data, size);
+    }
+    else {
+        m_hasher->update(data, size);
+    }
+}
+
+std::string tools::Digester::digest()
+{
+    if (m_coprocessLock.owns_lock())
+    {
+        const std::string hashSum = HashCoprocess::instance().finish();
+
+        m_coprocessLock.unlock();
+        return hashSum;
+    }
+    else if (m_hashBin) {
+        return finish_hash_bin(*m_hashBin);
+    }
+    else if (m_hasher) {
+        return hashing::tag(hashing::configured().name, m_hasher->hexdigest());
+    }
+    else {
+        return HashCache::TargetDoesNotExist;
+    }
+}
+
+std::string tools::hashFile(const std::string& path,
+                            const hashing::IoPolicy& policy)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0
+        || S_ISDIR(st.st_mode))
+    {
+        return HashCache::TargetDoesNotExist;
+    }
+    else if (!S_ISREG(st.st_mode)) {
+        return hashFileContents(path, policy);
+    }
+
+    return hashFile(path, StatCache::Key::fromStat(st), policy);
+}
+
+std::string tools::hashFile(const std::string& path,
+                            const StatCache::Key& key,
+                            const hashing::IoPolicy& policy)
+{
+    auto& statCache = StatCache::instance();
+    std::string digest;
+
+    if (!statCache.lookup(path, key, digest))
+    {
+        const int64_t hashedAt = StatCache::now();
+
+        if (hashing::loadXattrDigest(path, key, digest)) {
+            statCache.store(path, key, hashedAt, digest);
+            return digest;
+        }
+
+        digest = hashFileContents(path, policy);
+
+        if (digest != HashCache::TargetDoesNotExist) {
+            statCache.store(path, key, hashedAt, digest);
+            hashing::storeXattrDigest(path, key, hashedAt, digest);
+        }
+    }
+
+    return digest;
+}
+
+std::string tools::probeFile(const std::string& path)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0
+        || S_ISDIR(st.st_mode))
+    {
+        return HashCache::TargetDoesNotExist;
+    }
+
+    std::string digest;
+
+    if (!S_ISREG(st.st_mode)
+        || !StatCache::instance().lookup(path, StatCache::Key::fromStat(st), digest))
+    {
+        return std::string();
+    }
+
+    return digest;
+}
+
+tools::Strategy tools::parseStrategy(const std::string& name)
+{
+    if (name == "content") {
+        return Strategy::Content;
+    }
+    else if (name == "metadata") {
+        return Strategy::Metadata;
+    }
+    else if (name == "sampled") {
+        return Strategy::Sampled;
+    }
+    else {
+        throw std::runtime_error("unknown hash strategy '" + name + "'");
+    }
+}
+
+std::string tools::hashFileMetadata(const std::string& path)
+{
+    struct stat st;
+
+    if (stat(path.c_str(), &st) != 0
+        || S_ISDIR(st.st_mode))
+    {
+        return HashCache::TargetDoesNotExist;
+    }
+
+    char line[80];
+
+    const int length = snprintf(line, sizeof(line), "%llu\t%lld.%09ld\t%llu\n",
+                                static_cast<unsigned long long>(st.st_size),
+                                static_cast<long long>(st.st_mtim.tv_sec),
+                                static_cast<long>(st.st_mtim.tv_nsec),
+                                static_cast<unsigned long long>(st.st_ino));
+
+    auto hasher = hashing::configured().create();
+
+    hasher->update(line, length);
+
+    return hashing::tag(hashing::MetadataTag, hasher->hexdigest());
+}
+
+std::string tools::hashFileSampled(const std::string& path, unsigned int samples)
+{
+    utils::OpenFile file(path, O_RDONLY);
+    struct stat st;
+
+    if (!file.isOpen()
+        || fstat(file.fd(), &st) != 0
+        || !S_ISREG(st.st_mode))
+    {
+        return hashFile(path);
+    }
+
+    const uint64_t size = st.st_size;
+
+    if (size == 0) {
+        return HashCache::TargetDoesNotExist;
+    }
+
+    auto hasher = hashing::configured().create();
+
+    const std::string header = "sampled " + std::to_string(size) + ' ' + std::to_string(int(SampleBlockSize))
+        + ' ' + std::to_string(samples) + '\n';
+
+    hasher->update(header.data(), header.size());
+
+    // block offsets: the head, 'samples' between, and the tail; a file
+    // that is not much bigger than that is read whole
+
+    std::vector<uint64_t> offsets;
+
+    if (size <= uint64_t(samples + 2) * SampleBlockSize)
+    {
+        for (uint64_t offset = 0; offset < size; offset += SampleBlockSize) {
+            offsets.push_back(offset);
+        }
+    }
+    else {
+        const uint64_t last = size - SampleBlockSize;
+
+        offsets.push_back(0);
+
+        for (unsigned int i = 1; i <= samples; ++i) {
+            offsets.push_back(last * i / (samples + 1));
+        }
+
+        offsets.push_back(last);
+    }
+
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[SampleBlockSize]);
+
+    for (const uint64_t offset : offsets)
+    {
+        const std::size_t want = std::min<uint64_t>(SampleBlockSize, size - offset);
+        std::size_t have = 0;
+
+        while (have < want)
+        {
+            const ssize_t got = pread(file.fd(), buffer.get() + have, want - have, offset + have);
+
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw std::runtime_error("read failed while hashing '" + path + "': " + strerror(errno));
+            }
+            else if (got == 0) {
+                throw std::runtime_error("file '" + path + "' truncated while hashing");
+            }
+
+            have += got;
+        }
+
+        hasher->update(buffer.get(), want);
+    }
+
+    return hashing::tag(hashing::SampledTag, hasher->hexdigest());
 }
 
 // ------------------------------------------------------------
 
+namespace
+{
+    enum { MappedWindow = 1024 * 1024 };
+
+    std::string hashFileContents(const std::string& path, const hashing::IoPolicy& policy)
+    {
+        if (useHashBin())
+        {
+            std::ifstream ifs(path);
+
+            return (ifs
+                    ? tools::hash(ifs)
+                    : HashCache::TargetDoesNotExist);
+        }
+
+        //
+
+        utils::OpenFile file(path, O_RDONLY);
+        struct stat st;
+
+        if (!file.isOpen()
+            || fstat(file.fd(), &st) != 0
+            || S_ISDIR(st.st_mode))
+        {
+            return HashCache::TargetDoesNotExist;
+        }
+
+        const auto& algo = hashing::configured();
+
+        // regular files are hashed straight from a mapping; anything that
+        // cannot be mapped (procfs reports size 0, pipes have no size) is read,
+        // and so are files that are to stay out of the page cache
+
+        const uint64_t size = (S_ISREG(st.st_mode) ? st.st_size : 0);
+        const bool uncached = (size > 0 && policy.isUncached(size));
+
+        // uncached files are read with O_DIRECT if asked and the file system
+        // allows it, otherwise each block is dropped from the cache once read
+
+        std::unique_ptr<utils::OpenFile> direct;
+
+        if (uncached
+            && policy.uncachedMode == hashing::IoPolicy::Uncached::Direct)
+        {
+            direct.reset(new utils::OpenFile(path, O_RDONLY | O_DIRECT));
+        }
+
+        const int fd = (direct && direct->isOpen() ? direct->fd() : file.fd());
+
+        if (policy.readahead
+            && !uncached)
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        }
+
+        const utils::MappedFile mapped(fd, (uncached ? 0 : size));
+
+        if (hashing::isTreeHashed(size)) {
+            return hashing::treeHashFile(algo, fd, size, mapped.data(), policy);
+        }
+
+        auto hasher = algo.create();
+
+        if (mapped.isMapped())
+        {
+            // the mapping is fed in blocks only to pace it
+
+            const uint64_t window = (policy.bandwidth > 0 ? uint64_t(MappedWindow) : mapped.size());
+
+            for (uint64_t offset = 0; offset < mapped.size(); offset += window)
+            {
+                const std::size_t count = std::min<uint64_t>(window, mapped.size() - offset);
+
+                policy.throttle(count);
+                hasher->update(mapped.data() + offset, count);
+            }
+        }
+        else {
+            uint64_t offset = 0;
+
+            const uint64_t total = utils::readAll(fd,
+                                                  [&hasher, &policy, fd, uncached, &offset] (const uint8_t* data, std::size_t count)
+                                                  {
+                                                      policy.throttle(count);
+                                                      hasher->update(data, count);
+
+                                                      if (uncached) {
+                                                          posix_fadvise(fd, offset, count, POSIX_FADV_DONTNEED);
+                                                      }
+
+                                                      offset += count;
+                                                  });
+
+            if (total == 0) {
+                return HashCache::TargetDoesNotExist;
+            }
+        }
+
+        return hashing::tag(hashing::fileTag(algo), hasher->hexdigest());
+    }
+}
+
+// ------------------------------------------------------------
+
+namespace
+{
+    unsigned int artifactNameWidth(const Master& master)
+    {
+        unsigned int nameWidth = 20;
+
+        for (const auto& artifactPair : master.artifacts)
+        {
+            if (artifactPair.first.size() > nameWidth)
+                nameWidth = artifactPair.first.size();
+        }
+
+        return nameWidth;
+    }
+}
+
+//
+
 void tools::listArtifacts(const Master& master,
                           std::ostream& out)
 {
     namespace col = utils::ansi;
     //
 
-    unsigned int nameWidth = 20;
+    const unsigned int nameWidth = artifactNameWidth(master);
 
-    for (const auto& artifactPair : master.artifacts)
-    {
-        if (artifactPair.first.size() > nameWidth)
-            nameWidth = artifactPair.first.size();
+    //
+
+    std::vector<const HashCache*> artifacts;
+
+    for (const auto& artifactPair : master.artifacts) {
+        artifacts.push_back(artifactPair.second.get());
     }
 
+    const auto hashSums = tools::calculateHashes(artifacts);
+
     //
 
     utils::restore_ios rios(out);
+    std::size_t index = 0;
 
     for (const auto& artifactPair : master.artifacts)
     {
@@ -105,7 +686,7 @@ void tools::listArtifacts(const Master& master,
             << std::setw(nameWidth)
             << artifactPair.first << " : ";
 
-        const std::string hashSum = artifactPair.second->calculateHash();
+        const std::string& hashSum = hashSums[index++];
 
         if (hashSum == HashCache::TargetDoesNotExist)
         {
@@ -128,3 +709,51 @@ void tools::listArtifacts(const Master& master,
         out << std::endl;
     }
 }
+
+void tools::artifactStatus(const Master& master,
+                           std::ostream& out)
+{
+    namespace col = utils::ansi;
+    //
+
+    const unsigned int nameWidth = artifactNameWidth(master);
+
+    //
+
+    utils::restore_ios rios(out);
+
+    for (const auto& artifactPair : master.artifacts)
+    {
+        out << std::left
+            << std::setw(nameWidth)
+            << artifactPair.first << " : ";
+
+        const std::string hashSum = artifactPair.second->probeHash();
+
+        if (hashSum.empty())
+        {
+            out << col::Bold << col::Yellow
+                << "Modified"
+                << col::Normal;
+        }
+        else if (hashSum == HashCache::TargetDoesNotExist)
+        {
+            out << col::Bold << col::Black
+                << "Does not exist"
+                << col::Normal;
+        }
+        else if (artifactPair.second->matchesHash(hashSum))
+        {
+            out << col::Bold << col::Green
+                << "Up to date"
+                << col::Normal;
+        }
+        else {
+            out << col::Bold << col::Red
+                << "Dirty"
+                << col::Normal;
+        }
+
+        out << std::endl;
+    }
+}
@@ -6,13 +6,25 @@
 
 #pragma once
 
+#include "hash-algo.hh"
+#include "hash-io.hh"
+#include "stat-cache.hh"
+
+#include <cstddef>
 #include <iosfwd>
+#include <memory>
+#include <mutex>
 #include <string>
 
 // forward declarations
 
 class Master;
 
+namespace utils
+{
+    class Exec;
+}
+
 //
 
 namespace tools
@@ -20,5 +32,61 @@ namespace tools
     std::string hash(const std::string& input);
     std::string hash(std::istream& input);
 
+    // incremental hash(): input is fed piecewise, digest() of no input is
+    // HashCache::TargetDoesNotExist
+
+    class Digester {
+    public:
+        Digester();
+        ~Digester();
+
+        void update(const char* data, std::size_t size);
+        std::string digest();
+
+    private:
+        hashing::unique_hasher_t m_hasher;
+        std::unique_ptr<utils::Exec> m_hashBin;
+        std::unique_lock<std::mutex> m_coprocessLock;
+        std::ostream* m_hashBinInput = nullptr;
+
+        //
+
+        Digester(const Digester&) = delete;
+    };
+
+    std::string hashFile(const std::string& path,
+                         const hashing::IoPolicy& policy = hashing::IoPolicy::configured());
+    std::string hashFile(const std::string& path,
+                         const StatCache::Key& key,     // regular file, already stat'ed
+                         const hashing::IoPolicy& policy = hashing::IoPolicy::configured());
+    std::string probeFile(const std::string& path);
+
+    // How a file artifact or dependency is hashed:
+    //
+    //   content    all of it, with hashFile()
+    //   metadata   size, mtime (ns) and inode, no reading
+    //   sampled    size, the first and last block and 'samples' evenly
+    //              spaced blocks between them; small files are read whole
+    //
+    // metadata and sampled digests use hash_algo even with hash_bin, and
+    // carry their own tags so that changing the strategy re-baselines.
+
+    enum class Strategy {
+        Content,
+        Metadata,
+        Sampled,
+    };
+
+    enum {
+        SampleBlockSize = 64 * 1024,
+        DefaultSamples = 16,
+    };
+
+    Strategy parseStrategy(const std::string& name);
+
+    std::string hashFileMetadata(const std::string& path);
+    std::string hashFileSampled(const std::string& path, unsigned int samples = DefaultSamples);
+
     void listArtifacts(const Master& master, std::ostream& out);
+    void artifactStatus(const Master& master, std::ostream& out);
 }
@@ -0,0 +1,216 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-tree.hh"
+
+#include "config.hh"
+#include "hash-algo.hh"
+#include "hash-io.hh"
+#include "utils/blake3.hh"
+#include "utils/mapped-file.hh"
+#include "utils/parallel.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    class SegmentReader {
+    public:
+        SegmentReader(int fd, const uint8_t* mapped, const hashing::IoPolicy& policy, uint64_t size)
+            : m_fd(fd),
+              m_mapped(mapped),
+              m_policy(policy),
+              m_uncached(policy.isUncached(size)) {}
+
+        const uint8_t* read(uint64_t offset, std::size_t size)
+        {
+            if (m_mapped) {
+                return m_mapped + offset;
+            }
+
+            if (!m_buffer) {
+                m_buffer.reset(new utils::AlignedBuffer(hashing::TreeSegmentSize));
+            }
+
+            m_policy.throttle(size);
+
+            readSegment(m_fd, m_buffer->data(), size, offset);
+
+            // the segment is in our buffer now, the cached pages are not needed
+
+            if (m_uncached) {
+                posix_fadvise(m_fd, offset, size, POSIX_FADV_DONTNEED);
+            }
+
+            return m_buffer->data();
+        }
+
+    private:
+        int m_fd;
+        const uint8_t* m_mapped;
+        const hashing::IoPolicy& m_policy;
+        const bool m_uncached;
+        std::unique_ptr<utils::AlignedBuffer> m_buffer;
+
+        //
+
+        static void readSegment(int fd, uint8_t* buffer, std::size_t size, uint64_t offset);
+    };
+
+    // the request is rounded up to whole blocks for O_DIRECT; the buffer
+    // holds a whole segment and the file ends at or before the rounded size
+
+    void SegmentReader::readSegment(int fd, uint8_t* buffer, std::size_t size, uint64_t offset)
+    {
+        enum { Alignment = utils::AlignedBuffer::Alignment };
+
+        while (size > 0)
+        {
+            const std::size_t request = std::min<std::size_t>((size + Alignment - 1) / Alignment * Alignment,
+                                                              hashing::TreeSegmentSize);
+
+            const ssize_t got = pread(fd, buffer, request, offset);
+
+            if (got < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                throw std::runtime_error(std::string("read failed while hashing: ") + strerror(errno));
+            }
+            else if (got == 0) {
+                throw std::runtime_error("file truncated while hashing");
+            }
+
+            const std::size_t used = std::min<std::size_t>(got, size);
+
+            buffer += used;
+            size -= used;
+            offset += used;
+        }
+    }
+
+    std::string blake3Tree(int fd, uint64_t size, const uint8_t* mapped, const hashing::IoPolicy& policy)
+    {
+        using utils::Blake3;
+
+        enum { SegmentChunks = hashing::TreeSegmentSize / Blake3::ChunkSize };
+
+        // complete segments followed by more input become subtrees; the rest
+        // goes through the regular incremental path
+
+        const std::size_t segments = (size - 1) / hashing::TreeSegmentSize;
+
+        std::vector<uint32_t> cvs(segments * 8);
+
+        utils::parallelFor(segments,
+                           Config::instance().hashThreads(),
+                           [fd, size, mapped, &policy, &cvs] (std::size_t index)
+                           {
+                               SegmentReader reader(fd, mapped, policy, size);
+
+                               const uint8_t* segment = reader.read(uint64_t(index) * hashing::TreeSegmentSize,
+                                                                    hashing::TreeSegmentSize);
+
+                               Blake3::subtreeCV(segment, SegmentChunks, uint64_t(index) * SegmentChunks, &cvs[index * 8]);
+                           });
+
+        Blake3 hasher;
+
+        for (std::size_t i = 0; i < segments; ++i) {
+            hasher.addSubtree(&cvs[i * 8], SegmentChunks);
+        }
+
+        const uint64_t tailOffset = uint64_t(segments) * hashing::TreeSegmentSize;
+        const std::size_t tailSize = size - tailOffset;
+
+        SegmentReader reader(fd, mapped, policy, size);
+
+        hasher.update(reader.read(tailOffset, tailSize), tailSize);
+
+        return hasher.hexdigest();
+    }
+
+    std::string genericTree(const hashing::Algorithm& algo, int fd, uint64_t size, const uint8_t* mapped,
+                            const hashing::IoPolicy& policy)
+    {
+        const std::size_t segments = (size + hashing::TreeSegmentSize - 1) / hashing::TreeSegmentSize;
+
+        std::vector<std::string> digests(segments);
+
+        utils::parallelFor(segments,
+                           Config::instance().hashThreads(),
+                           [&algo, fd, size, mapped, &policy, &digests] (std::size_t index)
+                           {
+                               const uint64_t offset = uint64_t(index) * hashing::TreeSegmentSize;
+                               const std::size_t segmentSize = std::min<uint64_t>(hashing::TreeSegmentSize, size - offset);
+
+                               SegmentReader reader(fd, mapped, policy, size);
+
+                               auto hasher = algo.create();
+                               hasher->update(reader.read(offset, segmentSize), segmentSize);
+                               digests[index] = hasher->hexdigest();
+                           });
+
+        auto top = algo.create();
+        const std::string header = "tree " + std::to_string(int(hashing::TreeSegmentSize)) + '\n';
+
+        top->update(header.data(), header.size());
+
+        for (const auto& digest : digests)
+        {
+            top->update(digest.data(), digest.size());
+            top->update("\n", 1);
+        }
+
+        return top->hexdigest();
+    }
+}
+
+// ------------------------------------------------------------
+
+bool hashing::isTreeHashed(uint64_t size)
+{
+    const uint64_t threshold = Config::instance().hash_tree_threshold;
+
+    return size > 0
+        && threshold > 0
+        && size >= threshold;
+}
+
+std::string hashing::fileTag(const Algorithm& algo)
+{
+    if (algo.name == "blake3"
+        || Config::instance().hash_tree_threshold == 0)
+    {
+        return algo.name;
+    }
+
+    return algo.name + "-tree" + std::to_string(TreeSegmentSize / (1024 * 1024)) + 'm';
+}
+
+std::string hashing::treeHashFile(const Algorithm& algo,
+                                  int fd,
+                                  uint64_t size,
+                                  const uint8_t* mapped,
+                                  const IoPolicy& policy)
+{
+    if (algo.name == "blake3") {
+        return tag(fileTag(algo), blake3Tree(fd, size, mapped, policy));
+    }
+    else {
+        return tag(fileTag(algo), genericTree(algo, fd, size, mapped, policy));
+    }
+}
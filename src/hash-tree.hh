@@ -0,0 +1,55 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace hashing
+{
+    struct Algorithm;
+    struct IoPolicy;
+
+    // Large files are split into segments that are hashed in parallel.
+    //
+    // For blake3 the segments are subtrees of the algorithm's own tree, so
+    // the digest is the ordinary BLAKE3 digest of the file. Other algorithms
+    // hash each segment separately, and the file digest is the hash of
+    //
+    //     "tree <segment size>\n" <hex digest of segment 0> "\n" ...
+    //
+    // which differs from a plain digest of the same file.
+    //
+    // While hash_tree_threshold is set, every file digest of such an
+    // algorithm is tagged "<algorithm>-tree<segment size in MiB>m" (e.g.
+    // "sha256-tree4m"), whether the file was hashed flat or as a tree. The
+    // tag does not depend on the size of the file: a file growing past the
+    // threshold, or shrinking below it, keeps its tag and so reads as
+    // changed. Only setting or clearing the threshold changes the tag, and
+    // rebaselines the files like a change of hash_algo. Moving it changes
+    // the digests of the files crossing it, and those are rebuilt.
+    //
+    // Segments are taken from 'mapped' when the file is mapped, and read
+    // with pread() otherwise; only pread() follows the uncached and
+    // bandwidth settings of 'policy'.
+
+    enum { TreeSegmentSize = 4 * 1024 * 1024 };
+
+    bool isTreeHashed(uint64_t size);
+
+    // tag of the file digests of 'algo', flat and tree alike
+
+    std::string fileTag(const Algorithm& algo);
+
+    // tagged digest
+
+    std::string treeHashFile(const Algorithm& algo,
+                             int fd,
+                             uint64_t size,
+                             const uint8_t* mapped,
+                             const IoPolicy& policy);
+}
@@ -0,0 +1,101 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "hash-xattr.hh"
+
+#include "config.hh"
+#include "hash-algo.hh"
+#include "hash-cache.hh"
+#include "hash-tree.hh"
+
+#include <sstream>
+
+#include <sys/xattr.h>
+
+//
+
+namespace
+{
+    enum { MaxValueSize = 512 };
+
+    const std::string& attributeName()
+    {
+        static const std::string s_name = [] ()
+            {
+                const auto& conf = Config::instance();
+
+                return "user.swd." + (conf.hash_bin.empty()
+                                      ? conf.hash_algo
+                                      : hashing::HashBinTag);
+            }();
+
+        return s_name;
+    }
+
+    // the attribute is named by hash_algo only, so it may hold a digest
+    // tagged for another hash_tree_threshold
+
+    std::string expectedTag()
+    {
+        const auto& conf = Config::instance();
+
+        if (!conf.hash_bin.empty()) {
+            return hashing::HashBinTag;
+        }
+
+        return hashing::fileTag(hashing::configured());
+    }
+}
+
+// ------------------------------------------------------------
+
+bool hashing::loadXattrDigest(const std::string& path, const StatCache::Key& key, std::string& digest)
+{
+    if (!Config::instance().hash_xattr) {
+        return false;
+    }
+
+    char value[MaxValueSize];
+
+    const ssize_t length = getxattr(path.c_str(), attributeName().c_str(), value, sizeof(value));
+
+    if (length <= 0) {
+        return false;
+    }
+
+    std::istringstream iss(std::string(value, length));
+    uint64_t size;
+    int64_t mtime;
+    std::string stored;
+
+    if (!(iss >> size >> mtime >> stored)
+        || size != key.size
+        || mtime != key.mtime
+        || stored == HashCache::TargetDoesNotExist
+        || hashing::algorithmOf(stored) != expectedTag())
+    {
+        return false;
+    }
+
+    digest = stored;
+    return true;
+}
+
+void hashing::storeXattrDigest(const std::string& path, const StatCache::Key& key, int64_t hashedAt, const std::string& digest)
+{
+    if (!Config::instance().hash_xattr
+        || !StatCache::settled(key.mtime, hashedAt)
+        || digest == HashCache::TargetDoesNotExist)
+    {
+        return;
+    }
+
+    const std::string value = std::to_string(key.size) + ' ' + std::to_string(key.mtime) + ' ' + digest;
+
+    if (value.size() < MaxValueSize) {
+        setxattr(path.c_str(), attributeName().c_str(), value.data(), value.size(), 0);
+    }
+}
@@ -0,0 +1,31 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include "stat-cache.hh"
+
+#include <cstdint>
+#include <string>
+
+namespace hashing
+{
+    // Digests kept on the files themselves (hash_xattr yes), in the extended
+    // attribute "user.swd.<algorithm>" as
+    //
+    //     "<size> <mtime ns> <digest>"
+    //
+    // Unlike the stat cache they survive a wiped cache_dir and travel with
+    // the files (cp -a, rsync -X, tar --xattrs), so they are keyed by size
+    // and mtime only. Only digests of files whose mtime had settled when
+    // they were hashed are stored.
+    //
+    // File systems without extended attributes, and files that are not
+    // ours to write, are skipped without notice.
+
+    bool loadXattrDigest(const std::string& path, const StatCache::Key& key, std::string& digest);
+    void storeXattrDigest(const std::string& path, const StatCache::Key& key, int64_t hashedAt, const std::string& digest);
+}
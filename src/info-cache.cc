@@ -0,0 +1,165 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "info-cache.hh"
+
+#include "config.hh"
+#include "hash-tools.hh"
+#include "script-syntax.hh"
+#include "utils/path.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+//
+
+namespace
+{
+    std::string fileName(const std::string& unitPath)
+    {
+        // unit names start with a digit, so "root" is free
+
+        return Config::instance().cache_dir + "/info/" + (unitPath.empty() ? "root" : unitPath) + ".json";
+    }
+
+    json getenvOrNull(const std::string& name)
+    {
+        const char* value = getenv(name.c_str());
+
+        return value ? json(value) : json();
+    }
+
+    bool isCurrent(const std::string& execFile, const json& j)
+    {
+        if (!j.is_object()
+            || j.count("script") != 1 || !j.at("script").is_string()
+            || j.count("files") != 1  || !j.at("files").is_object()
+            || j.count("env") != 1    || !j.at("env").is_object()
+            || j.count("info") != 1)
+        {
+            return false;
+        }
+
+        if (j.at("script").get<std::string>() != tools::hashFile(execFile)) {
+            return false;
+        }
+
+        for (const auto& j_file : j.at("files").items())
+        {
+            if (!j_file.value().is_string()
+                || j_file.value().get<std::string>() != tools::hashFile(j_file.key()))
+            {
+                return false;
+            }
+        }
+
+        for (const auto& j_env : j.at("env").items())
+        {
+            if (j_env.value() != getenvOrNull(j_env.key())) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+// ------------------------------------------------------------
+
+bool InfoCache::lookup(const std::string& unitPath,
+                       const std::string& execFile,
+                       json& info)
+{
+    if (!Config::instance().swd_info_cache) {
+        return false;
+    }
+
+    std::ifstream ifs(fileName(unitPath));
+
+    if (!ifs) {
+        return false;
+    }
+
+    json j = json::parse(ifs, nullptr, false);
+
+    if (j.is_discarded()
+        || !isCurrent(execFile, j))
+    {
+        return false;
+    }
+
+    info = std::move(j["info"]);
+    return true;
+}
+
+void InfoCache::store(const std::string& unitPath,
+                      const std::string& execFile,
+                      const json& info)
+{
+    if (!Config::instance().swd_info_cache) {
+        return;
+    }
+
+    const std::string infoName = fileName(unitPath);
+
+    const json j_declared = info.count("swd_info_cache") ? info.at("swd_info_cache") : json(true);
+
+    syntax::checkInfoCache(j_declared);
+
+    if (j_declared == false) {
+        unlink(infoName.c_str());
+        return;
+    }
+
+    // with nothing declared, the script alone decides its output
+
+    json j = { { "script", tools::hashFile(execFile) },
+               { "files",  json::object()            },
+               { "env",    json::object()            },
+               { "info",   info                      } };
+
+    if (j_declared.is_object())
+    {
+        if (j_declared.count("files")) {
+            for (const auto& j_file : j_declared.at("files"))
+            {
+                const std::string path = j_file.get<std::string>();
+
+                j["files"][path] = tools::hashFile(path);
+            }
+        }
+
+        if (j_declared.count("env")) {
+            for (const auto& j_env : j_declared.at("env"))
+            {
+                const std::string name = j_env.get<std::string>();
+
+                j["env"][name] = getenvOrNull(name);
+            }
+        }
+    }
+
+    //
+
+    utils::safeMkdirs(infoName.substr(0, infoName.rfind('/')));
+
+    const std::string tmpName = infoName + ".tmp";
+
+    {
+        std::ofstream ofs(tmpName);
+
+        if (!(ofs << j.dump() << std::endl)) {
+            throw std::runtime_error("failed to write swd_info cache file: " + tmpName);
+        }
+    }
+
+    if (rename(tmpName.c_str(), infoName.c_str()) != 0) {
+        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + infoName + "'");
+    }
+}
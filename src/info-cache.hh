@@ -0,0 +1,39 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "json/single_include/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+//
+
+// swd_info output of scripts and group files, kept in cache_dir/info per
+// unit so that scripts are not run at startup when nothing has changed.
+// An entry is used while the contents of the script are as they were when
+// it was run, and so are the files and environment variables its output
+// declares (paths relative to the directory of .swd.conf):
+//
+//     "swd_info_cache": { "files": [ "include/tr_exec.sh" ], "env": [ "TR" ] }
+//
+// Scripts whose output depends on anything else declare
+// "swd_info_cache": false; "swd_info_cache no" in .swd.conf turns the
+// cache off altogether.
+
+namespace InfoCache
+{
+    // 'unitPath' as by tools::conjurePath(), 'execFile' the script run
+
+    bool lookup(const std::string& unitPath,
+                const std::string& execFile,
+                json& info);
+    void store(const std::string& unitPath,
+               const std::string& execFile,
+               const json& info);
+}
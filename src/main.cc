@@ -4,10 +4,13 @@
  * Licensed under The MIT License, see file LICENSE.txt in this source tree.
  */
 
+#include "cache-shards.hh"
 #include "config.hh"
+#include "daemon-socket.hh"
 #include "hash-tools.hh"
 #include "master.hh"
 #include "script-tools.hh"
+#include "script-travelers.hh"
 
 #include <cctype>
 #include <iostream>
@@ -44,7 +47,13 @@ namespace
             "        swd - scripts with dependencies\n"
             "\n"
             "SYNOPSIS\n"
-            "        swd [ options... ] [ function ]\n"
+            "        swd [ options... ] [ function ] [ unit ]\n"
+            "\n"
+            "        A <unit> (group, script or step, e.g. \"02-grp/01-b one\") limits\n"
+            "        the function to that unit and the steps upstream of it: those\n"
+            "        before its steps in their scripts, and those producing the\n"
+            "        artifacts they depend on. Only the scripts these are in are\n"
+            "        loaded.\n"
             "\n"
             "FUNCTIONS\n"
             "        (default)\n"
@@ -59,6 +68,14 @@ namespace
             "        --list-artifacts\n"
             "            List all known artifacts.\n"
             "\n"
+            "        --export-cache-json\n"
+            "            Print the saved state of artifacts and steps as JSON.\n"
+            "\n"
+            "        --status\n"
+            "            Show the state of steps and artifacts without reading file\n"
+            "            contents. Files changed since they were last hashed are\n"
+            "            reported as modified.\n"
+            "\n"
             "        " << Args::next_L << " | " << Args::next_S << "\n"
             "            Print the name of the next step, but do not execute it.\n"
             "\n"
@@ -72,7 +89,18 @@ namespace
             "            Execute steps interactively.\n"
             "\n"
             "        " << Args::rehash_L << "=<artifact> | " << Args::rehash_S << " <artifact>\n"
-            "            Rehash (validate) artifact.\n"
+            "            Rehash (validate) artifact. For directories hashed by content,\n"
+            "            print the files added (A), deleted (D) or modified (M) since\n"
+            "            the previous hash.\n"
+            "\n"
+            "        --daemon\n"
+            "            Keep the scripts and their state loaded, and serve the other\n"
+            "            functions run in this tree through a socket in cache_dir,\n"
+            "            until interrupted. Scripts edited meanwhile are loaded again.\n"
+            "            Steps are run in the environment of the client: a client\n"
+            "            started in another environment restarts the daemon in it.\n"
+            "            " << Args::interactive_L << " is not served, and is refused while a daemon\n"
+            "            is running.\n"
             "\n"
             "OPTIONS\n"
             "        -C <path>\n"
@@ -81,12 +109,103 @@ namespace
 
     // -----
 
+    // saved state of a unit, or of its subtree; steps have theirs in the
+    // script's shard
+
+    class load_unit_cache : public Unit::Visitor {
+    public:
+        load_unit_cache(Master& master, bool subtree)
+            : m_master(master),
+              m_subtree(subtree) {}
+
+        void operator() (Group& group) const override   { load(group); }
+        void operator() (Script& script) const override { load(script); }
+        void operator() (Step& step) const override     { load(*step.parent()); }
+
+    private:
+        Master& m_master;
+        const bool m_subtree;
+
+        //
+
+        void load(Unit& unit) const
+        {
+            if (m_subtree) {
+                m_master.loadCache(unit);
+            }
+            else {
+                m_master.loadUnitCache(unit);
+            }
+        }
+    };
+
+    // -----
+
     class MainFunction {
     public:
         virtual ~MainFunction() = default;
         virtual void execute(Master& master) = 0;
+
+        // functions that work on a unit of their own do not take one from
+        // the command line
+
+        virtual bool takesTarget() const { return true; }
+
+        // by a resident swd (--daemon) when there is one
+
+        virtual bool servedByDaemon() const { return true; }
+
+        void setTarget(const std::string& target)
+        {
+            m_target = target;
+        }
+
+        // the swd_info and saved state the function needs; all of it by
+        // default, or that of the target and what is upstream of it
+
+        virtual void load(Master& master)
+        {
+            loadConfig(master);
+            master.loadCache();
+        }
+
+        // functions that do not need the scripts override this instead
+
+        virtual void run()
+        {
+            Master& master = Master::instance();
+
+            load(master);
+            execute(master);
+        }
+
+    protected:
+        std::string m_target;
+
+        //
+
+        void loadConfig(Master& master) const
+        {
+            if (m_target.empty()) {
+                master.loadConfig();
+            }
+            else {
+                // steps are known only once their script is loaded
+
+                master.loadConfig(master.unit(m_target.substr(0, m_target.find(' '))));
+            }
+        }
+
+        Unit* target(Master& master) const
+        {
+            return (m_target.empty()
+                    ? nullptr
+                    : &master.unit(m_target));
+        }
     };
 
+    void serveRequest(Master& master, const std::vector<std::string>& args);
+
     //
 
     namespace Oper
@@ -101,11 +220,43 @@ namespace
 
         //
 
+        class ExportCacheJson : public MainFunction {
+        public:
+            bool takesTarget() const override { return false; }
+
+            void execute(Master&) override
+            {
+                run();
+            }
+
+            void run() override
+            {
+                CacheShards::exportJson(std::cout);
+            }
+        };
+
+        //
+
+        class Status : public MainFunction {
+        public:
+            void execute(Master& master) override
+            {
+                tools::status(master, std::cout);
+            }
+        };
+
+        //
+
         class ListSteps : public MainFunction {
         public:
+            void load(Master& master) override
+            {
+                loadConfig(master);
+            }
+
             void execute(Master& master) override
             {
-                tools::listSteps(*master.root,
+                tools::listSteps(m_target.empty() ? *master.root : *target(master),
                                  std::cout);
             }
         };
@@ -123,7 +274,8 @@ namespace
                 tools::execute(master,
                                m_steps,
                                false,
-                               false);
+                               false,
+                               target(master));
             }
 
         private:
@@ -139,7 +291,8 @@ namespace
                 tools::execute(master,
                                -1,
                                true,
-                               false);
+                               false,
+                               target(master));
             }
         };
 
@@ -150,6 +303,16 @@ namespace
             Undo(const std::string& stepName)
                 : m_stepName(stepName) {}
 
+            bool takesTarget() const override { return false; }
+
+            void load(Master& master) override
+            {
+                master.loadConfig(master.unit(m_stepName.substr(0, m_stepName.find(' '))));
+
+                master.root->apply(travelers::FindUnit(m_stepName,
+                                                       load_unit_cache(master, true)));
+            }
+
             void execute(Master& master) override
             {
                 tools::undo(master,
@@ -164,6 +327,19 @@ namespace
 
         class Interactive : public MainFunction {
         public:
+            bool servedByDaemon() const override { return false; }
+
+            void run() override
+            {
+                // steps would be run twice at the same time
+
+                if (DaemonSocket::isRunning()) {
+                    throw std::runtime_error("swd daemon running on " + DaemonSocket::fileName() + ", stop it first");
+                }
+
+                MainFunction::run();
+            }
+
             void execute(Master& master) override
             {
                 Config::setenv("SWD_INTERACTIVE", "yes");
@@ -171,7 +347,8 @@ namespace
                 tools::execute(master,
                                -1,
                                false,
-                               true);
+                               true,
+                               target(master));
             }
         };
 
@@ -182,16 +359,63 @@ namespace
             RehashArtifact(const std::string& name)
                 : m_artifactName(name) {}
 
+            bool takesTarget() const override { return false; }
+
+            void load(Master& master) override
+            {
+                const std::string::size_type slash = m_artifactName.rfind('/');
+
+                master.loadConfig(master.unit(slash != std::string::npos
+                                              ? m_artifactName.substr(0, slash)
+                                              : std::string()));
+
+                master.root->apply(travelers::FindUnit(master.artifact(m_artifactName).scope(),
+                                                       load_unit_cache(master, false)));
+            }
+
             void execute(Master& master) override
             {
                 auto& artifact = master.artifact(m_artifactName);
+                std::vector<std::string> changedPaths;
+
+                artifact.recalculate(&changedPaths);
 
-                artifact.recalculate();
+                for (const auto& change : changedPaths) {
+                    std::cout << change << '\n';
+                }
             }
 
         private:
             std::string m_artifactName;
         };
+
+        //
+
+        class Daemon : public MainFunction {
+        public:
+            bool takesTarget() const override { return false; }
+            bool servedByDaemon() const override { return false; }
+
+            // errors are shown to the clients as they come, once a request
+            // needs what failed to load
+
+            void load(Master& master) override
+            {
+                try {
+                    master.loadConfig();
+                    master.loadCache();
+                }
+                catch (std::exception& e) {
+                    std::cerr << e.what() << std::endl;
+                }
+            }
+
+            void execute(Master& master) override
+            {
+                DaemonSocket::serve([&master] { return master.refresh(); },
+                                    [&master] (const std::vector<std::string>& args) { serveRequest(master, args); });
+            }
+        };
     }
 
     //
@@ -290,6 +514,7 @@ namespace
         //
 
         std::unique_ptr<MainFunction> mainFunction;
+        std::string target;
 
         for (auto iter = args.begin();
              iter != args.end();
@@ -321,6 +546,30 @@ namespace
 
                 mainFunction = std::make_unique<Oper::ListArtifacts>();
             }
+            else if (longArgMatches(*iter, "--export-cache-json", false))
+            {
+                if (mainFunction) {
+                    throw std::runtime_error("second argument declaring main function: " + *iter);
+                }
+
+                mainFunction = std::make_unique<Oper::ExportCacheJson>();
+            }
+            else if (longArgMatches(*iter, "--daemon", false))
+            {
+                if (mainFunction) {
+                    throw std::runtime_error("second argument declaring main function: " + *iter);
+                }
+
+                mainFunction = std::make_unique<Oper::Daemon>();
+            }
+            else if (longArgMatches(*iter, "--status", false))
+            {
+                if (mainFunction) {
+                    throw std::runtime_error("second argument declaring main function: " + *iter);
+                }
+
+                mainFunction = std::make_unique<Oper::Status>();
+            }
             else if (*iter == Args::next_S
                      || longArgMatches(*iter, Args::next_L, false))
             {
@@ -392,14 +641,88 @@ namespace
 
                 mainFunction = std::make_unique<Oper::RehashArtifact>( artifactName );
             }
+            else if (!iter->empty()
+                     && (*iter)[0] != '-')
+            {
+                if (!target.empty()) {
+                    throw std::runtime_error("second unit argument: " + *iter);
+                }
+
+                target = *iter;
+            }
             else {
                 throw std::runtime_error("invalid argument '" + *iter + "'");
             }
         }
 
-        return (mainFunction
-                ? std::move(mainFunction)
-                : std::make_unique<Oper::ExecuteSteps>());
+        if (!mainFunction) {
+            mainFunction = std::make_unique<Oper::ExecuteSteps>();
+        }
+
+        if (!target.empty())
+        {
+            if (!mainFunction->takesTarget()) {
+                throw std::runtime_error("function does not take a unit argument: " + target);
+            }
+
+            mainFunction->setTarget(target);
+        }
+
+        return mainFunction;
+    }
+
+    // -----
+
+    void serveRequest(Master& master, const std::vector<std::string>& args)
+    {
+        for (const auto& arg : args)
+        {
+            if (arg == "-C") {
+                throw std::runtime_error("-C is not served by the swd daemon");
+            }
+            else if (arg == "-?"
+                     || arg == "--help")
+            {
+                printUsage();
+                return;
+            }
+        }
+
+        const auto mainFunction = parseArguments(args);
+
+        if (!mainFunction->servedByDaemon()) {
+            throw std::runtime_error("function is not served by the swd daemon");
+        }
+
+        try {
+            mainFunction->load(master);
+            mainFunction->execute(master);
+        }
+        catch (...) {
+            master.save();
+            throw;
+        }
+
+        master.save();
+    }
+
+    // the arguments of a client, as run in the directory of the daemon
+
+    std::vector<std::string> daemonArguments(const std::vector<std::string>& args)
+    {
+        std::vector<std::string> forwarded;
+
+        for (auto iter = args.begin(); iter != args.end(); ++iter)
+        {
+            if (*iter == "-C") {
+                ++iter;                 // parseArguments() has checked it is there
+            }
+            else {
+                forwarded.push_back(*iter);
+            }
+        }
+
+        return forwarded;
     }
 }
 
@@ -415,9 +738,13 @@ int main(const int argc,
 
         //
 
-        Master& master = Master::instance();
+        if (mainFunction->servedByDaemon()
+            && DaemonSocket::forward(daemonArguments(args)))
+        {
+            return 0;
+        }
 
-        mainFunction->execute(master);
+        mainFunction->run();
     }
     catch (std::exception& e) {
         std::cerr << e.what() << std::endl;
@@ -6,26 +6,46 @@
 
 #include "master.hh"
 
+#include "cache-journal.hh"
+#include "cache-shards.hh"
 #include "config.hh"
 #include "scan.hh"
+#include "script-config.hh"
+#include "stat-cache.hh"
 #include "script-tools.hh"
+#include "script-travelers.hh"
 #include "utils/path.hh"
 
-#include "json/single_include/nlohmann/json.hpp"
-
-#include <fstream>
 #include <iostream>
+#include <set>
 #include <stdexcept>
+#include <vector>
 
-using json = nlohmann::json;
-
-//
+#include <unistd.h>
 
 namespace
 {
-    std::string artifactCacheFileName()
+    class find_unit : public Unit::Visitor {
+    public:
+        find_unit(Unit*& found)
+            : m_found(found) {}
+
+        void operator() (Group& group) const override   { m_found = &group; }
+        void operator() (Script& script) const override { m_found = &script; }
+        void operator() (Step& step) const override     { m_found = &step; }
+
+    private:
+        Unit*& m_found;
+    };
+
+    std::vector<std::string> unitPaths(Group& root)
     {
-        return Config::instance().cache_dir + "/artifacts.json";
+        std::vector<std::string> paths;
+
+        root.apply(travelers::ForEach(lambdaVisitor([&paths] (Group& group) { paths.push_back(tools::conjurePath(group) + '/'); })));
+        root.apply(travelers::ForEach(lambdaVisitor([&paths] (Script& script) { paths.push_back(tools::conjurePath(script)); })));
+
+        return paths;
     }
 }
 
@@ -41,138 +61,206 @@ Artifact& Master::artifact(const std::string& name)
     return *iter->second;
 }
 
+Unit& Master::unit(const std::string& path)
+{
+    Unit* found = nullptr;
+
+    root->apply(travelers::FindUnit(path,
+                                    find_unit(found)));
+
+    return *found;              // FindUnit throws if there is none
+}
+
 Master& Master::instance()
 {
     static Master s_master;
     return s_master;
 }
 
-void Master::loadArtifactCache()
+void Master::loadConfig()
 {
-    std::ifstream ifs(artifactCacheFileName());
-
-    if (ifs) {
-        json j;
+    if (!m_config->isComplete())
+    {
+        m_config->load(*root);
+        m_shards->indexArtifacts();
+    }
+}
 
-        if (!(ifs >> j)) {
-            throw std::runtime_error("failed to import JSON from artifact save file");
-        }
+void Master::loadConfig(Unit& unit)
+{
+    std::vector<Unit*> pending{ &unit };
+    std::set<Unit*> seen{ &unit };
+    std::set<std::string> artifactsSeen;
 
-        for (const auto& j_pair : j.items())
+    const auto add = [&pending, &seen] (Unit& next)
         {
-            auto artIter = artifacts.find(j_pair.key());
-
-            if (artIter != artifacts.end())
-            {
-                json& j_value = j_pair.value();
-
-                if (!j_value.is_object()) {
-                    throw std::runtime_error("malformed artifact save data: artifact value must be an object");
-                }
+            if (seen.insert(&next).second) {
+                pending.push_back(&next);
+            }
+        };
 
-                // "hash"
+    while (!pending.empty())
+    {
+        Unit& next = *pending.back();
+        pending.pop_back();
+
+        m_config->load(next);
+
+        // the unit declaring each artifact depended on, and the scripts
+        // producing it, wherever they are
+
+        next.apply(travelers::ForEach(lambdaVisitor([this, &add, &artifactsSeen] (Step& step)
+                                                    {
+                                                        step.forEachDependency([this, &add, &artifactsSeen] (Dependency& dep)
+                                                                               {
+                                                                                   if (dep.type() != "artifact"
+                                                                                       || !artifactsSeen.insert(dep.id()).second)
+                                                                                   {
+                                                                                       return;
+                                                                                   }
+
+                                                                                   const std::string::size_type slash = dep.id().rfind('/');
+
+                                                                                   add(this->unit(slash != std::string::npos
+                                                                                                  ? dep.id().substr(0, slash)
+                                                                                                  : std::string()));
+
+                                                                                   for (Script* producer : m_config->producers(dep.id())) {
+                                                                                       add(*producer);
+                                                                                   }
+                                                                               });
+                                                    })));
+    }
 
-                if (j_value.count("hash") != 1) {
-                    throw std::runtime_error("malformed artifact save data: artifact must contain hash");
-                }
+    m_shards->indexArtifacts();
+}
 
-                if (!j_value["hash"].is_string()) {
-                    throw std::runtime_error("malformed artifact save data: artifact hash must be a string");
-                }
+void Master::loadCache()
+{
+    // a migration brings in everything saved, so everything must be there
+    // to take it
 
-                artIter->second->storeHash(j_value["hash"].get<std::string>());
+    if (m_shards->needsMigration()) {
+        loadConfig();
+    }
 
-                // "marks"
+    for (Unit* unit : m_config->loaded()) {
+        m_shards->loadUnit(*unit);
+    }
 
-                if (j_value.count("marks") == 1)
-                {
-                    if (!j_value["marks"].is_object()) {
-                        throw std::runtime_error("malformed artifact save data: artifact marks must be an object");
-                    }
+    startJournal();
+}
 
-                    for (auto& j_mark : j_value["marks"].items())
-                    {
-                        if (j_mark.value().is_string() == false) {
-                            throw std::runtime_error("malformed artifact save data: artifact marks contain non-string link type");
-                        }
+void Master::loadCache(Unit& unit)
+{
+    m_shards->loadTree(unit);
+    startJournal();
+}
 
-                        artIter->second->restoreMark( j_mark.key(),
-                                                      Artifact::Link::parse(j_mark.value().get<std::string>()) );
-                    }
-                }
-            }
-        }
-    }
-    else {
-        std::cout << "Artifact cache file does not exist." << std::endl;
-    }
+void Master::loadUnitCache(Unit& unit)
+{
+    m_shards->loadUnit(unit);
+    startJournal();
 }
 
-void Master::saveArtifactCache() const
+bool Master::refresh()
 {
-    utils::safeMkdir(Config::instance().cache_dir);
+    if (unitPaths(*scanScripts()) != unitPaths(*root)) {
+        save();
+        return false;
+    }
 
-    //
+    const std::vector<Unit*> changed = m_config->changed();
 
-    const std::string fileName = artifactCacheFileName();
-    const std::string tmpName = fileName + ".tmp";
+    if (changed.empty()) {
+        return true;
+    }
 
-    std::ofstream ofs(tmpName);
+    std::vector<Script*> scripts;
 
-    if (!ofs) {
-        throw std::runtime_error("failed to open artifact cache file: " + tmpName);
+    for (Unit* unit : changed) {
+        unit->apply(lambdaVisitor([&scripts] (Script& script) { scripts.push_back(&script); }));
     }
 
-    //
+    save();
 
-    json j;
+    if (scripts.size() < changed.size()) {          // a group file
+        return false;
+    }
 
-    for ( const auto& artPair : artifacts)
+    for (Script* script : scripts)
     {
-        json& j_art = j[artPair.first];
+        m_config->unload(*script);
 
-        // "hash"
+        try {
+            loadConfig(*script);
+        }
+        catch (...) {
+            m_config->unload(*script);              // tried again when loaded next
+            m_shards->indexArtifacts();
+            throw;
+        }
 
-        j_art["hash"] = artPair.second->getHashSum();
+        m_shards->reloadUnit(*script);
+    }
 
-        // "marks"
+    return true;
+}
 
-        bool first = true;
+void Master::save()
+{
+    saveCache();
+    StatCache::instance().save();
 
-        for (const auto& mark : artPair.second->getMarks())
-        {
-            if (first) {
-                j_art["marks"] = json::object();
-                first = false;
-            }
+    if (m_journalStarted) {
+        CacheJournal::instance().start();
+    }
+}
 
-            j_art["marks"][mark.name] = Artifact::Link::typeToString( mark.type );
-        }
+void Master::startJournal()
+{
+    if (m_journalStarted) {
+        return;
     }
 
-    //
+    m_journalStarted = true;
 
-    if (!(ofs << j.dump(1, '\t') << std::endl)) {
-        throw std::runtime_error("failed to save artifact JSON data");
-    }
+    // a journal left by a killed run may refer to any unit
 
-    if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
-        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + fileName + "'");
+    if (access(CacheJournal::fileName().c_str(), F_OK) == 0) {
+        loadConfig();
     }
+
+    // whatever a killed run did after the shards were saved
+
+    CacheJournal::instance().replay(*this);
+    CacheJournal::instance().start();
+}
+
+void Master::saveCache()
+{
+    m_shards->save();
+    m_config->save();
+
+    CacheJournal::instance().discard();
 }
 
 Master::Master()
-    : root(scanScripts())
+    : root(scanScripts()),
+      m_config(std::make_unique<ScriptConfig>(*this)),
+      m_shards(std::make_unique<CacheShards>(*this))
 {
-    tools::loadScriptConfig(*this, *root);
-    loadArtifactCache();
+
+    // constructed before Master is, so they are still alive in ~Master()
+
+    CacheJournal::instance();
+    StatCache::instance();
 }
 
 Master::~Master()
 {
     try {
-        saveArtifactCache();
-        tools::saveScriptCache(*root);
+        save();
     }
     catch (std::exception& e) {
         std::cerr << "exception during saving cache:\n    " << e.what() << std::endl;
@@ -10,8 +10,16 @@
 #include "script.hh"
 
 #include <map>
+#include <memory>
 #include <string>
 
+// forward declarations
+
+class CacheShards;
+class ScriptConfig;
+
+//
+
 struct Master {
     unique_group_t root;
     std::map<std::string, unique_artifact_t> artifacts;
@@ -19,14 +27,45 @@ struct Master {
     //
 
     Artifact& artifact(const std::string& name);
+    Unit& unit(const std::string& path);
+
+    // swd_info is loaded as the function at hand needs it: all of it, or
+    // 'unit' with the units declaring the artifacts its steps depend on
+    // and the scripts producing them, and so on upstream
+
+    void loadConfig();
+    void loadConfig(Unit& unit);
+
+    // saved state likewise: of every unit whose swd_info is loaded, the
+    // subtree of 'unit', or 'unit' alone
+
+    void loadCache();
+    void loadCache(Unit& unit);
+    void loadUnitCache(Unit& unit);
+
+    // For a Master kept resident: the scripts edited since they were
+    // loaded are loaded again. False if the tree itself has changed, or a
+    // group file has, which takes a new Master.
+
+    bool refresh();
+
+    // saved state written now, as it is when Master goes
+
+    void save();
 
     //
 
     static Master& instance();
 
 private:
-    void loadArtifactCache();
-    void saveArtifactCache() const;
+    std::unique_ptr<ScriptConfig> m_config;
+    std::unique_ptr<CacheShards> m_shards;
+    bool m_journalStarted = false;
+
+    //
+
+    void startJournal();
+    void saveCache();
 
     //
 
@@ -8,14 +8,17 @@
 
 #include "config.hh"
 #include "script.hh"
-#include "utils/path.hh"
+#include "utils/parallel.hh"
 
-#include <algorithm>
 #include <cstring>
-#include <regex>
+#include <memory>
 #include <stdexcept>
 
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -23,76 +26,182 @@ using namespace std;
 
 namespace
 {
-    bool isValidScriptName(const string& name)
+    struct linux_dirent64 {
+        ino64_t        d_ino;
+        off64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[];
+    };
+
+    inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    inline bool isLower(char c) { return c >= 'a' && c <= 'z'; }
+    inline bool isAlpha(char c) { return isLower(c) || (c >= 'A' && c <= 'Z'); }
+
+    // length of the unit name at the start of 'name', or 0 if there is none:
+    //
+    //     [0-9]([0-9][a-z]?)?-[a-zA-Z][a-zA-Z0-9_-]*
+
+    size_t matchUnitName(const char* name)
     {
-        static const regex s_exp("[0-9]([0-9][a-z]?)?-[a-zA-Z][a-zA-Z0-9_-]*\\.swd");
+        const char* p = name;
 
-        return regex_match(name,
-                           s_exp);
+        if (!isDigit(*p++)) {
+            return 0;
+        }
+
+        if (isDigit(*p))
+        {
+            ++p;
+
+            if (isLower(*p)) {
+                ++p;
+            }
+        }
+
+        if (*p++ != '-'
+            || !isAlpha(*p++))
+        {
+            return 0;
+        }
+
+        while (isAlpha(*p) || isDigit(*p) || *p == '_' || *p == '-') {
+            ++p;
+        }
+
+        return p - name;
     }
 
-    bool isValidGroupName(const string& name)
+    bool isValidGroupName(const char* name)
     {
-        static const regex s_exp("[0-9]([0-9][a-z]?)?-[a-zA-Z][a-zA-Z0-9_-]*");
+        const size_t length = matchUnitName(name);
 
-        return regex_match(name,
-                           s_exp);
+        return length > 0
+            && name[length] == '\0';
     }
 
-    string removeScriptFileExt(const string& fileName)
+    bool isValidScriptName(const char* name)
     {
-        const string& Ext = Script::FileExt;
+        const size_t length = matchUnitName(name);
+
+        return length > 0
+            && strcmp(name + length, Script::FileExt.c_str()) == 0;
+    }
 
-        if (fileName.compare(fileName.size() - Ext.size(), Ext.size(), Ext) == 0)
+    //
+
+    struct DirFd {
+        const int fd;
+
+        DirFd(int dirFd, const char* name, const string& path)
+            : fd(openat(dirFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC))
         {
-            return fileName.substr(0, fileName.size() - Ext.size());
+            if (fd < 0) {
+                throw runtime_error("openat(\"" + path + "\"): " + strerror(errno));
+            }
+        }
+
+        ~DirFd() { close(fd); }
+
+        DirFd(const DirFd&) = delete;
+    };
+
+    // follows symbolic links, like stat() by path
+
+    struct stat statEntry(int dirFd, const char* name, const string& path)
+    {
+        struct stat st;
+
+        if (fstatat(dirFd, name, &st, 0) != 0) {
+            throw runtime_error("stat(\"" + path + "\"): " + strerror(errno));
         }
 
-        return fileName;
+        return st;
     }
 
-    void scanDirectory(Group& group,
+    // Adds the scripts and subgroups in 'path' to 'group'. Only names that
+    // can be units are looked at any closer, and a subdirectory is
+    // stat'ed only when getdents64 leaves its type open. Subgroups are
+    // scanned as tasks of their own; each task adds to its own group only,
+    // and opens its directory by path, so no descriptors are held by
+    // queued tasks.
+
+    void scanDirectory(utils::TaskPool& pool,
+                       Group& group,
                        const string& path)
     {
-        utils::OpenDir dir(path);
+        const DirFd dir(AT_FDCWD, path.c_str(), path);
 
-        for (struct dirent* entry;
-             (entry =dir.readdir());
-             )
+        enum { BufferSize = 32 * 1024 };
+        alignas(linux_dirent64) char buffer[BufferSize];
+
+        for (;;)
         {
-            if (entry->d_name[0] == '.') {
-                continue;
+            const long count = syscall(SYS_getdents64, dir.fd, buffer, BufferSize);
+
+            if (count < 0) {
+                throw runtime_error("getdents64(\"" + path + "\"): " + strerror(errno));
+            }
+            else if (count == 0) {
+                break;
             }
 
-            const string fileName = entry->d_name;
-            const string nameAbs = path + '/' + fileName;
+            for (long offset = 0; offset < count; )
+            {
+                const auto* entry = reinterpret_cast<const linux_dirent64*>(buffer + offset);
+                const char* name = entry->d_name;
 
-            //
+                offset += entry->d_reclen;
 
-            struct stat st;
+                if (name[0] == '.') {
+                    continue;
+                }
 
-            if (stat(nameAbs.c_str(), &st) != 0) {
-                throw runtime_error("stat(\"" + nameAbs + "\"): " + strerror(errno));
-            }
+                const bool maybeScript = isValidScriptName(name);
 
-            if (S_ISDIR(st.st_mode))        // directory
-            {
-                if (isValidGroupName(fileName)) {
-                    Group& subGroup = *new Group(fileName,
-                                                 group);
+                if (!maybeScript
+                    && !isValidGroupName(name))
+                {
+                    continue;
+                }
+
+                const string nameAbs = path + '/' + name;
+                unsigned char type = entry->d_type;
+                mode_t mode = 0;
 
-                    group.add(unique_unit_t(&subGroup));
+                if (type == DT_UNKNOWN
+                    || type == DT_LNK
+                    || (type == DT_REG && maybeScript))
+                {
+                    const struct stat st = statEntry(dir.fd, name, nameAbs);
 
-                    scanDirectory(subGroup,
-                                  nameAbs);
+                    type = (S_ISDIR(st.st_mode) ? DT_DIR : DT_REG);
+                    mode = st.st_mode;
                 }
-            }
-            else if (st.st_mode & S_IXUSR)      // owner-executable
-            {
-                if (isValidScriptName(fileName))
+
+                //
+
+                if (type == DT_DIR)             // directory
+                {
+                    if (!maybeScript) {
+                        Group& subGroup = *new Group(name,
+                                                     group);
+
+                        group.add(unique_unit_t(&subGroup));
+
+                        pool.spawn([&pool, &subGroup, nameAbs]
+                                   {
+                                       scanDirectory(pool, subGroup, nameAbs);
+                                   });
+                    }
+                }
+                else if (mode & S_IXUSR)        // owner-executable
                 {
-                    group.add(std::make_unique<Script>(removeScriptFileExt(fileName),
-                                                       group));
+                    if (maybeScript)
+                    {
+                        group.add(std::make_unique<Script>(string(name, strlen(name) - Script::FileExt.size()),
+                                                           group));
+                    }
                 }
             }
         }
@@ -104,8 +213,12 @@ std::unique_ptr<Group> scanScripts()
     auto& conf = Config::instance();
     auto group = Group::newRoot(conf.root);
 
-    scanDirectory(*group,
-                  conf.root);
+    utils::TaskPool pool(utils::hardwareThreads());
+    pool.spawn([&pool, &group, &conf]
+               {
+                   scanDirectory(pool, *group, conf.root);
+               });
+    pool.run();
 
     return group;
 }
@@ -0,0 +1,837 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "script-config.hh"
+
+#include "config.hh"
+#include "hash-cache_impl.hh"
+#include "hash-tools.hh"
+#include "info-cache.hh"
+#include "master.hh"
+#include "script-syntax.hh"
+#include "script-tools.hh"
+#include "script-travelers.hh"
+#include "script.hh"
+#include "utils/exec.hh"
+#include "utils/parallel.hh"
+#include "utils/path.hh"
+#include "utils/string.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    json execSwdInfo(const std::string& unitPath, const std::string& execFile)
+    {
+        json j;
+
+        if (InfoCache::lookup(unitPath, execFile, j)) {
+            return j;
+        }
+
+        const std::string execCommand = execFile + " swd_info";
+        utils::Exec execSwdInfo(execCommand);
+
+        std::stringstream ssSwdInfo;
+        ssSwdInfo << execSwdInfo.read().rdbuf();
+
+        if (!execSwdInfo.wait()) {
+            throw std::runtime_error("exec failed: " + execCommand);
+        }
+
+        ssSwdInfo >> j;
+
+        InfoCache::store(unitPath, execFile, j);
+        return j;
+    }
+
+    std::string groupFile(const std::string& groupName)
+    {
+        return (groupName.empty()
+                ? Config::instance().root + "/group.swd"
+                : Config::instance().root + '/' + groupName + "/group.swd");
+    }
+
+    std::string scriptFile(const std::string& scriptName)
+    {
+        return Config::instance().root + '/' + scriptName + Script::FileExt;
+    }
+
+    // of a file that may not exist, as a group file need not
+
+    StatCache::Key stampOf(const std::string& fileName)
+    {
+        struct stat st;
+
+        if (stat(fileName.c_str(), &st) != 0) {
+            return StatCache::Key{};
+        }
+
+        return StatCache::Key::fromStat(st);
+    }
+
+    using stamps_t = std::map<Unit*, std::pair<std::string, StatCache::Key>>;
+
+    // units on the way from the root to a unit, and under it
+
+    class OnPath {
+    public:
+        OnPath(Unit& unit)
+            : m_unit(unit)
+        {
+            for (Unit* parent = unit.parent(); parent; parent = parent->parent()) {
+                m_above.insert(parent);
+            }
+        }
+
+        bool operator() (Unit& unit) const
+        {
+            if (m_above.count(&unit)) {
+                return true;
+            }
+
+            for (Unit* u = &unit; u; u = u->parent())
+            {
+                if (u == &m_unit) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    private:
+        Unit& m_unit;
+        std::set<const Unit*> m_above;
+    };
+
+    // -----
+
+    // swd_info output of the group files and scripts add()ed, run up to
+    // Config::swdInfoJobs() at a time and checked as it comes in. An
+    // error is kept with its unit and thrown when the unit is taken, so
+    // the tree is still loaded, and fails, in order.
+
+    class SwdInfos {
+    public:
+        void add(Group& group)
+        {
+            const std::string groupName = tools::conjurePath(group);
+            const std::string groupFileName = groupFile(groupName);
+
+            if (access(groupFileName.c_str(), X_OK) == 0) {
+                add(group, groupName, groupFileName, true);
+            }
+        }
+
+        void add(Script& script)
+        {
+            const std::string scriptName = tools::conjurePath(script);
+
+            add(script, scriptName, scriptFile(scriptName), false);
+        }
+
+        void run()
+        {
+            utils::parallelFor(m_infos.size(),
+                               Config::instance().swdInfoJobs(),
+                               [this] (std::size_t index)
+                               {
+                                   Info& info = m_infos[index];
+
+                                   try {
+                                       info.output = execSwdInfo(info.unitPath, info.execFile);
+
+                                       if (info.isGroup) {
+                                           syntax::checkGroupFile(info.output);
+                                       }
+                                       else {
+                                           syntax::checkScriptFile(info.output);
+                                       }
+                                   }
+                                   catch (...) {
+                                       info.error = std::current_exception();
+                                   }
+                               });
+        }
+
+        json take(const Unit& unit)
+        {
+            Info& info = m_infos.at(m_index.at(&unit));
+
+            if (info.error) {
+                std::rethrow_exception(info.error);
+            }
+
+            return std::move(info.output);
+        }
+
+    private:
+        struct Info {
+            std::string unitPath;
+            std::string execFile;
+            bool isGroup;
+            json output;
+            std::exception_ptr error;
+        };
+
+        std::vector<Info> m_infos;
+        std::unordered_map<const Unit*, std::size_t> m_index;
+
+        //
+
+        void add(const Unit& unit,
+                 const std::string& unitPath,
+                 const std::string& execFile,
+                 bool isGroup)
+        {
+            m_index.emplace(&unit, m_infos.size());
+            m_infos.push_back(Info{ unitPath, execFile, isGroup, json(), nullptr });
+        }
+    };
+
+    // -----
+
+    // Files are stamped before swd_info is run, so an edit made while it
+    // runs is seen as a change later on.
+
+    class pending_units : public Unit::Visitor {
+    public:
+        pending_units(const OnPath& onPath,
+                      const std::set<Unit*>& loaded,
+                      SwdInfos& infos,
+                      stamps_t& stamps,
+                      std::vector<Script*>& scripts)
+            : m_onPath(onPath),
+              m_loaded(loaded),
+              m_infos(infos),
+              m_stamps(stamps),
+              m_scripts(scripts) {}
+
+        void operator() (Group& group) const override
+        {
+            if (!m_onPath(group)) {
+                return;
+            }
+
+            if (!m_loaded.count(&group))
+            {
+                const std::string fileName = groupFile(tools::conjurePath(group));
+
+                m_stamps[&group] = { fileName, stampOf(fileName) };
+                m_infos.add(group);
+            }
+
+            group.applyChildren(*this);
+        }
+
+        void operator() (Script& script) const override
+        {
+            if (m_onPath(script)
+                && !m_loaded.count(&script))
+            {
+                const std::string fileName = scriptFile(tools::conjurePath(script));
+
+                m_stamps[&script] = { fileName, stampOf(fileName) };
+                m_scripts.push_back(&script);
+                m_infos.add(script);
+            }
+        }
+
+    private:
+        const OnPath& m_onPath;
+        const std::set<Unit*>& m_loaded;
+        SwdInfos& m_infos;
+        stamps_t& m_stamps;
+        std::vector<Script*>& m_scripts;
+    };
+
+    // -----
+
+    class load_basics : public Unit::Visitor {
+    public:
+        load_basics(Master& master,
+                    SwdInfos& infos,
+                    const OnPath& onPath,
+                    std::set<Unit*>& loaded,
+                    std::map<const Group*, json>& rules)
+            : m_master(master),
+              m_infos(infos),
+              m_onPath(onPath),
+              m_loaded(loaded),
+              m_rules(rules) {}
+
+        void operator() (Group& group) const override
+        {
+            if (!m_onPath(group)) {
+                return;
+            }
+
+            const std::string groupName = tools::conjurePath(group);
+            const bool isThisRootGroup = groupName.empty();
+            const std::string groupFileName = groupFile(groupName);
+
+            if (access(groupFileName.c_str(), F_OK) == 0)
+            {
+                if (access(groupFileName.c_str(), X_OK) != 0) {
+                    throw std::runtime_error(groupFileName + " found but it is not executable");
+                }
+
+                try {
+                    if (m_loaded.insert(&group).second)
+                    {
+                        const json j = m_infos.take(group);
+
+                        // artifacts
+
+                        parseArtifacts(j, groupName);
+
+                        // rules, for the scripts to apply
+
+                        if (j.count("rules") > 0) {
+                            m_rules.emplace(&group, j["rules"]);
+                        }
+                    }
+
+                    //
+
+                    group.applyChildren(*this);
+                }
+                catch (std::exception& e) {
+                    throw std::runtime_error(({
+                                std::ostringstream oss;
+                                oss << (isThisRootGroup ? "(root)" : groupName) << " : " << e.what();
+                                oss.str();
+                            }));
+                }
+            }
+            else {
+                m_loaded.insert(&group);
+                group.applyChildren(*this);
+            }
+        }
+
+        void operator() (Script& script) const override
+        {
+            if (!m_onPath(script)
+                || !m_loaded.insert(&script).second)
+            {
+                return;
+            }
+
+            const std::string scriptName = tools::conjurePath(script);
+
+            try {
+                json j = m_infos.take(script);
+
+                // artifacts
+
+                parseArtifacts(j, scriptName);
+
+                // steps
+
+                if (j.count("steps")) {
+                    for (auto& j_step : j["steps"])
+                    {
+                        // flags
+
+                        Step::Flags flags;
+
+                        if (j_step.count("flags")) {
+                            for (auto& j_flag : j_step["flags"])
+                            {
+                                const std::string flagName = utils::tolower( j_flag.get<std::string>() );
+
+                                if (flagName == "always")    flags |= Step::Flag::Always;
+                                else if (flagName == "sudo") flags |= Step::Flag::Sudo;
+                            }
+                        }
+
+                        //
+
+                        Step& newStep = *new Step(j_step["name"],
+                                                  script,
+                                                  flags);
+
+                        script.add(unique_step_t(&newStep));
+
+                        //
+
+                        // artifact links
+
+                        if (j_step.count("artifacts") > 0)
+                        {
+                            for (const auto& artIter : j_step["artifacts"].items())
+                            {
+                                std::string artifactName = artIter.key();
+                                const json& j_artLinkType = artIter.value();
+
+                                if (artifactName[0] == '/') {
+                                    artifactName.erase(0, 1);
+                                }
+                                else {
+                                    artifactName = scriptName + '/' + artifactName;
+                                }
+
+                                //
+
+                                newStep.addArtifactLink(artifactName,
+                                                        Step::ArtifactLink::parse(j_artLinkType.get<std::string>()));
+                            }
+                        }
+
+                        // dependencies
+
+                        loadDependencies(m_master, j_step, newStep, scriptName);
+                    }
+                }
+
+                // rules of the groups above, innermost first
+
+                for (Group* group = script.parent(); group; group = group->parent()) {
+                    applyRules(script, *group);
+                }
+            }
+            catch (std::exception& e) {
+                throw std::runtime_error(({
+                            std::ostringstream oss;
+                            oss << scriptName << " : " << e.what();
+                            oss.str();
+                        }));
+            }
+        }
+
+        static void loadDependencies(Master& master, const json& j, Step& step, const std::string& baseName)
+        {
+            if (j.count("dependencies") <= 0) {
+                return;
+            }
+
+            for (auto& j_dep : j["dependencies"])
+            {
+                const std::string type = j_dep["type"].get<std::string>();
+
+                if (type == "artifact") {
+                    std::string artifactName = j_dep["id"].get<std::string>();
+
+                    if (artifactName[0] == '/') {
+                        artifactName.erase(0, 1);
+                    }
+                    else {
+                        artifactName = baseName + '/' + artifactName;
+                    }
+
+                    step.addDependency(std::make_unique<DependencyArtifact>(master,
+                                                                            artifactName));
+                }
+                else if (type == "data") {
+                    step.addDependency(std::make_unique<DependencyData>(j_dep["id"].get<std::string>(),
+                                                                        j_dep["data"].get<std::string>()));
+                }
+                else if (type == "file") {
+                    step.addDependency(std::make_unique<DependencyFile>(j_dep["id"].get<std::string>(),
+                                                                        j_dep["path"].get<std::string>(),
+                                                                        parseStrategy(j_dep, "content")));
+                }
+            }
+        }
+
+    private:
+        Master& m_master;
+        SwdInfos& m_infos;
+        const OnPath& m_onPath;
+        std::set<Unit*>& m_loaded;
+        std::map<const Group*, json>& m_rules;
+
+        //
+
+        static tools::Strategy parseStrategy(const json& value, const std::string& defaultStrategy)
+        {
+            return tools::parseStrategy(value.count("strategy") > 0
+                                        ? value["strategy"].get<std::string>()
+                                        : defaultStrategy);
+        }
+
+        // "io": { "readahead": bool, "uncached_size": bytes,
+        //         "uncached_mode": "dontneed"|"direct", "bandwidth": bytes/s },
+        // each overriding .swd.conf; null if not given
+
+        static std::unique_ptr<hashing::IoPolicy> parseIoPolicy(const json& value,
+                                                                const std::string& artifactName)
+        {
+            if (value.count("io") <= 0) {
+                return nullptr;
+            }
+
+            const json& j_io = value["io"];
+            std::unique_ptr<hashing::IoPolicy> io(new hashing::IoPolicy(hashing::IoPolicy::configured()));
+
+            try {
+                if (j_io.count("readahead") > 0) {
+                    io->readahead = j_io["readahead"].get<bool>();
+                }
+                if (j_io.count("uncached_size") > 0) {
+                    io->uncachedSize = j_io["uncached_size"].get<uint64_t>();
+                }
+                if (j_io.count("uncached_mode") > 0) {
+                    io->uncachedMode = hashing::IoPolicy::parseUncachedMode(j_io["uncached_mode"].get<std::string>());
+                }
+                if (j_io.count("bandwidth") > 0) {
+                    io->setBandwidth(j_io["bandwidth"].get<uint64_t>());
+                }
+            }
+            catch (std::exception& e) {
+                throw std::runtime_error("artifact '" + artifactName + "' has invalid io settings: " + e.what());
+            }
+
+            return io;
+        }
+
+        void parseArtifacts(const json& j,
+                            const std::string& unitName) const
+        {
+            if (j.count("artifacts") <= 0)
+                return;
+
+            for (auto& j_art : j["artifacts"].items())
+            {
+                const std::string& key = j_art.key();
+                const json& value = j_art.value();
+
+                //
+
+                const std::string artifactName = ( !unitName.empty()
+                                                   ? unitName + '/' + key
+                                                   : key );
+
+                const std::string type = value["type"].get<std::string>();
+                const std::string path = value["path"].get<std::string>();
+
+                Artifact* artifact = nullptr;
+
+                if (type == "file")
+                {
+                    const bool chunked = (value.count("chunked") > 0
+                                          && value["chunked"].get<bool>());
+
+                    if (chunked) {
+                        artifact = new ArtifactChunkedFile(artifactName,
+                                                           unitName,
+                                                           path);
+                    }
+                    else {
+                        artifact = new ArtifactFile(artifactName,
+                                                    unitName,
+                                                    path,
+                                                    parseStrategy(value, "content"),
+                                                    parseIoPolicy(value, artifactName));
+                    }
+                }
+                else if (type == "directory")
+                {
+                    std::vector<std::string> excludeDirs;
+
+                    if (value.count("exclude") > 0) {
+                        for (const auto& ex : value["exclude"]) {
+                            excludeDirs.push_back(ex.get<std::string>());
+                        }
+                    }
+
+                    const std::string hashMode = (value.count("strategy") > 0
+                                                  ? value["strategy"].get<std::string>()
+                                                  : value.count("hash") > 0
+                                                  ? value["hash"].get<std::string>()
+                                                  : "metadata");
+
+                    if (hashMode == "metadata")
+                    {
+                        artifact = new ArtifactDir(artifactName,
+                                                   unitName,
+                                                   path,
+                                                   std::move( excludeDirs ));
+                    }
+                    else if (hashMode == "content")
+                    {
+                        artifact = new ArtifactContentDir(artifactName,
+                                                          unitName,
+                                                          path,
+                                                          std::move( excludeDirs ),
+                                                          parseIoPolicy(value, artifactName));
+                    }
+                    else {
+                        throw std::runtime_error("artifact '" + artifactName + "' has invalid strategy '" + hashMode + "'");
+                    }
+                }
+
+                m_master.artifacts.emplace(artifactName,
+                                           unique_artifact_t(artifact));
+            }
+        }
+
+        void applyRules(Script& script, Group& group) const
+        {
+            const auto rules = m_rules.find(&group);
+
+            if (rules == m_rules.end()) {
+                return;
+            }
+
+            const std::string groupName = tools::conjurePath(group);
+
+            for (auto& j_rule : rules->second.items())
+            {
+                const std::string& stepName = j_rule.key();
+                const json& j_stepRules = j_rule.value();
+
+                // "dependencies"
+
+                if (j_stepRules.count("dependencies"))
+                {
+                    if (Step* step = script.findStep(stepName)) {
+                        loadDependencies(m_master, j_stepRules, *step, groupName);
+                    }
+                }
+            }
+        }
+    };
+}
+
+// ------------------------------------------------------------
+
+ScriptConfig::ScriptConfig(Master& master)
+    : m_master(master)
+{
+    m_master.root->apply(travelers::ForEach(lambdaVisitor([this] (Group&) { ++m_unitCount; })));
+    m_master.root->apply(travelers::ForEach(lambdaVisitor([this] (Script&) { ++m_unitCount; })));
+}
+
+ScriptConfig::~ScriptConfig() = default;
+
+void ScriptConfig::load(Unit& unit)
+{
+    const OnPath onPath(unit);
+    SwdInfos infos;
+
+    std::vector<Script*> scripts;
+
+    m_master.root->apply(pending_units(onPath, m_loaded, infos, m_stamps, scripts));
+    infos.run();
+
+    m_master.root->apply(load_basics(m_master, infos, onPath, m_loaded, m_rules));
+
+    for (Script* script : scripts) {
+        record(*script);
+    }
+}
+
+std::vector<Unit*> ScriptConfig::changed() const
+{
+    std::vector<Unit*> units;
+
+    for (const auto& stamp : m_stamps)
+    {
+        if (m_loaded.count(stamp.first)
+            && !(stampOf(stamp.second.first) == stamp.second.second))
+        {
+            units.push_back(stamp.first);
+        }
+    }
+
+    return units;
+}
+
+void ScriptConfig::unload(Script& script)
+{
+    const std::string scriptName = tools::conjurePath(script);
+
+    for (auto iter = m_master.artifacts.begin(); iter != m_master.artifacts.end(); )
+    {
+        if (iter->second->scope() == scriptName) {
+            iter = m_master.artifacts.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+
+    script.clear();
+
+    m_loaded.erase(&script);
+    m_stamps.erase(&script);
+
+    // unknown until loaded again
+
+    loadProduced();
+
+    if (m_produced.erase(scriptName) > 0) {
+        m_producedDirty = true;
+    }
+}
+
+std::vector<Script*> ScriptConfig::producers(const std::string& artifact)
+{
+    loadProduced();
+
+    std::vector<Script*> scripts;
+
+    m_master.root->apply(travelers::ForEach(lambdaVisitor([this, &artifact, &scripts] (Script& script)
+                                                          {
+                                                              if (m_loaded.count(&script))
+                                                              {
+                                                                  bool produces = false;
+
+                                                                  script.applyChildren(lambdaVisitor([&artifact, &produces] (Step& step)
+                                                                                                     {
+                                                                                                         produces = produces || step.hasArtifactLink(artifact);
+                                                                                                     }));
+
+                                                                  if (produces) {
+                                                                      scripts.push_back(&script);
+                                                                  }
+
+                                                                  return;
+                                                              }
+
+                                                              const std::string scriptName = tools::conjurePath(script);
+                                                              const auto iter = m_produced.find(scriptName);
+
+                                                              if (iter != m_produced.end()
+                                                                  && !m_producedCurrent.count(scriptName))
+                                                              {
+                                                                  if (stampOf(scriptFile(scriptName)) == iter->second.stamp) {
+                                                                      m_producedCurrent.insert(scriptName);
+                                                                  }
+                                                                  else {
+                                                                      m_produced.erase(iter);
+                                                                      m_producedDirty = true;
+                                                                  }
+                                                              }
+
+                                                              const auto known = m_produced.find(scriptName);
+
+                                                              if (known == m_produced.end()
+                                                                  || std::find(known->second.artifacts.begin(),
+                                                                               known->second.artifacts.end(),
+                                                                               artifact) != known->second.artifacts.end())
+                                                              {
+                                                                  scripts.push_back(&script);
+                                                              }
+                                                          })));
+
+    return scripts;
+}
+
+void ScriptConfig::save()
+{
+    if (!m_producedDirty) {
+        return;
+    }
+
+    json j = json::object();
+
+    for (const auto& entry : m_produced)
+    {
+        const StatCache::Key& stamp = entry.second.stamp;
+
+        j[entry.first] = { { "stamp",     { stamp.dev, stamp.ino, stamp.size, stamp.mtime, stamp.ctime } },
+                           { "artifacts", entry.second.artifacts                                        } };
+    }
+
+    const std::string fileName = producedFileName();
+    const std::string tmpName = fileName + ".tmp";
+
+    utils::safeMkdirs(Config::instance().cache_dir);
+
+    {
+        std::ofstream ofs(tmpName);
+
+        if (!(ofs << j.dump() << std::endl)) {
+            throw std::runtime_error("failed to write producer index: " + tmpName);
+        }
+    }
+
+    if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + fileName + "'");
+    }
+
+    m_producedDirty = false;
+}
+
+void ScriptConfig::record(Script& script)
+{
+    loadProduced();
+
+    Produced& produced = m_produced[tools::conjurePath(script)];
+
+    produced.stamp = m_stamps.at(&script).second;
+    produced.artifacts.clear();
+
+    script.applyChildren(lambdaVisitor([&produced] (Step& step)
+                                       {
+                                           for (const auto& link : step.artifactLinks()) {
+                                               produced.artifacts.push_back(link.name);
+                                           }
+                                       }));
+
+    m_producedCurrent.insert(tools::conjurePath(script));
+    m_producedDirty = true;
+}
+
+// an index that cannot be read is started over; every script not loaded
+// is then taken as a producer
+
+void ScriptConfig::loadProduced()
+{
+    if (m_producedLoaded) {
+        return;
+    }
+
+    m_producedLoaded = true;
+
+    std::ifstream ifs(producedFileName());
+
+    if (!ifs) {
+        return;
+    }
+
+    try {
+        json j;
+        ifs >> j;
+
+        for (const auto& entry : j.items())
+        {
+            const json& j_stamp = entry.value().at("stamp");
+            Produced produced;
+
+            produced.stamp = StatCache::Key{ j_stamp.at(0).get<uint64_t>(),
+                                             j_stamp.at(1).get<uint64_t>(),
+                                             j_stamp.at(2).get<uint64_t>(),
+                                             j_stamp.at(3).get<int64_t>(),
+                                             j_stamp.at(4).get<int64_t>() };
+            produced.artifacts = entry.value().at("artifacts").get<std::vector<std::string>>();
+
+            m_produced.emplace(entry.key(), std::move(produced));
+        }
+    }
+    catch (std::exception&) {
+        m_produced.clear();
+    }
+}
+
+std::string ScriptConfig::producedFileName()
+{
+    return Config::instance().cache_dir + "/producers.json";
+}
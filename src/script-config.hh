@@ -0,0 +1,90 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include "stat-cache.hh"
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "json/single_include/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+// forward declarations
+
+class Group;
+struct Master;
+class Script;
+class Unit;
+
+//
+
+// swd_info of the scripts and group files, loaded as the function at hand
+// needs it. A unit is loaded with the group files above it, whose
+// artifacts it may use and whose rules add dependencies to its steps.
+// Nothing is loaded twice, so the rules of a group are kept for scripts
+// loaded later on.
+
+class ScriptConfig {
+public:
+    ScriptConfig(Master& master);
+    ~ScriptConfig();
+
+    // 'unit' and everything under it
+
+    void load(Unit& unit);
+
+    bool isComplete() const { return m_loaded.size() == m_unitCount; }
+    const std::set<Unit*>& loaded() const { return m_loaded; }
+
+    // loaded units whose script or group file has changed since; a script
+    // is unload()ed, with its steps and artifacts, to be loaded again
+
+    std::vector<Unit*> changed() const;
+    void unload(Script& script);
+
+    // Scripts with steps that may produce 'artifact', which any step in
+    // the tree can. The artifacts produced by every script loaded are
+    // kept in cache_dir/producers.json, so a script not loaded now is
+    // known by what it produced when it was, unless it has changed since.
+    // Scripts not known either way are taken as producers.
+
+    std::vector<Script*> producers(const std::string& artifact);
+
+    void save();
+
+private:
+    struct Produced {
+        StatCache::Key stamp;
+        std::vector<std::string> artifacts;
+    };
+
+    Master& m_master;
+    std::set<Unit*> m_loaded;
+    std::map<const Group*, json> m_rules;
+    std::map<Unit*, std::pair<std::string, StatCache::Key>> m_stamps;      // file, as it was loaded
+    std::size_t m_unitCount = 0;
+
+    std::map<std::string, Produced> m_produced;         // by script path
+    std::set<std::string> m_producedCurrent;            // entries checked against their script
+    bool m_producedLoaded = false;
+    bool m_producedDirty = false;
+
+    //
+
+    void record(Script& script);
+    void loadProduced();
+
+    static std::string producedFileName();
+
+    ScriptConfig(const ScriptConfig&) = delete;
+};
@@ -45,10 +45,51 @@ void syntax::checkArtifact(const string& name,
     ASSERT(type == "directory"
            || type == "file", "artifact/type has an unknown value '" + type + "'");
 
+    // strategy
+
+    string strategy = "content";
+
+    if (j.count("strategy") > 0) {
+        ASSERT(j["strategy"].is_string(), "artifact/strategy must be a string");
+
+        strategy = j["strategy"].get<string>();
+    }
+
+    // [type=file]
+
+    if (type == "file")
+    {
+        ASSERT(strategy == "content"
+               || strategy == "metadata"
+               || strategy == "sampled", "artifact[type=file]/strategy has an unknown value '" + strategy + "'");
+
+        if (j.count("chunked") > 0) {
+            ASSERT(j["chunked"].is_boolean(), "artifact[type=file]/chunked must be a boolean");
+            ASSERT(!j["chunked"].get<bool>()
+                   || strategy == "content", "artifact[type=file]/chunked requires strategy 'content'");
+        }
+    }
+
     // [type=directory]
 
     if (type == "directory")
     {
+        // [type=directory]/strategy, formerly [type=directory]/hash
+
+        if (j.count("hash") > 0) {
+            ASSERT(j["hash"].is_string(), "artifact[type=directory]/hash must be a string");
+
+            if (j.count("strategy") <= 0) {
+                strategy = j["hash"].get<string>();
+            }
+        }
+        else if (j.count("strategy") <= 0) {
+            strategy = "metadata";
+        }
+
+        ASSERT(strategy == "content"
+               || strategy == "metadata", "artifact[type=directory]/strategy has an unknown value '" + strategy + "'");
+
         // [type=directory]/exclude
 
         if (j.count("exclude") > 0) {
@@ -104,6 +145,39 @@ void syntax::checkDependency(const json& j)
 
         ASSERT(j.count("path") > 0,   "dependency[type=file]/path must exist");
         ASSERT(j["path"].is_string(), "dependency[type=file]/path must be a string");
+
+        // dependency[type=file]/strategy
+
+        if (j.count("strategy") > 0) {
+            ASSERT(j["strategy"].is_string(), "dependency[type=file]/strategy must be a string");
+
+            const string strategy = j["strategy"].get<string>();
+
+            ASSERT(strategy == "content"
+                   || strategy == "metadata"
+                   || strategy == "sampled", "dependency[type=file]/strategy has an unknown value '" + strategy + "'");
+        }
+    }
+}
+
+void syntax::checkInfoCache(const json& j)
+{
+    if (j.is_boolean()) {
+        return;
+    }
+
+    ASSERT(j.is_object(), "swd_info_cache must be a boolean or an object");
+
+    for (const char* member : { "files", "env" })
+    {
+        if (j.count(member) > 0)
+        {
+            ASSERT(j[member].is_array(), string("swd_info_cache/") + member + " must be an array");
+
+            for (const auto& j_item : j[member]) {
+                ASSERT(j_item.is_string(), string("swd_info_cache/") + member + " must contain strings");
+            }
+        }
     }
 }
 
@@ -187,6 +261,10 @@ void syntax::checkGroupFile(const json& j)
 {
     ASSERT(j.is_object(), "group-json must be an object");
 
+    if (j.count("swd_info_cache") > 0) {
+        checkInfoCache(j["swd_info_cache"]);
+    }
+
     if (j.count("artifacts") > 0) {
         ASSERT(j["artifacts"].is_object(), "artifact container must be an object");
 
@@ -212,6 +290,10 @@ void syntax::checkScriptFile(const json& j)
 {
     ASSERT(j.is_object(), "script-json must be an object");
 
+    if (j.count("swd_info_cache") > 0) {
+        checkInfoCache(j["swd_info_cache"]);
+    }
+
     // artifacts
 
     if (j.count("artifacts") > 0) {
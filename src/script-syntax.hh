@@ -26,6 +26,7 @@ namespace syntax
     void checkArtifact(const std::string& name, const json& j);
     void checkDependency(const json& j);
     void checkDependencyArray(const json& j);
+    void checkInfoCache(const json& j);
     void checkRule(const std::string& name, const json& j);
     void checkStep(const json& j);
 
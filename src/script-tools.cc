@@ -6,12 +6,15 @@
 
 #include "script-tools.hh"
 
+#include "cache-journal.hh"
+
 #include "config.hh"
 #include "hash-cache_impl.hh"
+#include "hash-tools.hh"
 #include "master.hh"
-#include "script-syntax.hh"
 #include "script-travelers.hh"
 #include "script.hh"
+#include "step-zygote.hh"
 #include "utils/ansi.hh"
 #include "utils/exec.hh"
 #include "utils/string.hh"
@@ -19,7 +22,10 @@
 #include "json/single_include/nlohmann/json.hpp"
 
 #include <iostream>
+#include <memory>
+#include <set>
 #include <sstream>
+#include <unordered_map>
 
 #include <unistd.h>
 
@@ -103,349 +109,196 @@ std::string tools::conjureExec(Unit& unit)
 
 namespace
 {
-    std::string stepCacheFileName()
-    {
-        return Config::instance().cache_dir + "/steps.json";
-    }
+    // cached state of one step, dependency digests keyed by
+    // dependencyKey(); restoring a step is then linear in its dependencies
 
-    //
+    struct SavedStep {
+        bool completed = false;
+        std::unordered_map<std::string, hashing::Digest> hashes;
+    };
 
-    class load_basics : public Unit::Visitor {
-    public:
-        load_basics(Master& master)
-            : m_master(master) {}
+    std::string dependencyKey(const std::string& type, const std::string& id)
+    {
+        std::string key;
 
-        void operator() (Group& group) const override
-        {
-            const std::string groupName = tools::conjurePath(group);
-            const bool isThisRootGroup = groupName.empty();
-            const std::string groupFileName = (isThisRootGroup
-                                               ? Config::instance().root + "/group.swd"
-                                               : Config::instance().root + '/' + groupName + "/group.swd");
+        key.reserve(type.size() + 1 + id.size());
+        key += type;
+        key += '\0';
+        key += id;
 
-            if (access(groupFileName.c_str(), F_OK) == 0)
-            {
-                if (access(groupFileName.c_str(), X_OK) != 0) {
-                    throw std::runtime_error(groupFileName + " found but it is not executable");
-                }
+        return key;
+    }
 
-                try {
-                    const json j = execSwdInfo(groupFileName);
+    void restoreStep(Step& step,
+                     const std::string& stepName,
+                     const SavedStep& saved)
+    {
+        // completed
 
-                    syntax::checkGroupFile(j);
+        if (saved.completed)
+        {
+            try {
+                step.complete();
+            } catch (std::runtime_error& ex) {
+                std::cout << "Failing to complete step '" << stepName << "' because: " << ex.what() << std::endl;
+            }
+        }
 
-                    // artifacts
+        // dependencies
 
-                    parseArtifacts(j, groupName);
+        if (saved.hashes.empty()) {
+            return;
+        }
 
-                    //
+        step.forEachDependency([&saved] (Dependency& dep)
+                               {
+                                   const auto iter = saved.hashes.find(dependencyKey(dep.type(), dep.id()));
 
-                    group.applyChildren(*this);
+                                   if (iter != saved.hashes.end()) {
+                                       dep.storeHash(iter->second);
+                                   }
+                               });
+    }
 
-                    // rules
+    // steps are restored script by script, so that the path of the script
+    // is conjured once and not for every step
 
-                    parseRules(group, groupName, j);
-                }
-                catch (std::exception& e) {
-                    throw std::runtime_error(({
-                                std::ostringstream oss;
-                                oss << (isThisRootGroup ? "(root)" : groupName) << " : " << e.what();
-                                oss.str();
-                            }));
-                }
-            }
-            else {
-                group.applyChildren(*this);
-            }
-        }
+    class load_step_cache : public Unit::Visitor {
+    public:
+        load_step_cache(const CacheSnapshot& snapshot)
+            : m_snapshot(snapshot) {}
 
         void operator() (Script& script) const override
         {
             const std::string scriptName = tools::conjurePath(script);
-            const std::string scriptExec = Config::instance().root + '/' + scriptName + Script::FileExt;
-
-            try {
-                json j = execSwdInfo(scriptExec);
-
-                syntax::checkScriptFile(j);
-
-                // artifacts
 
-                parseArtifacts(j, scriptName);
-
-                // steps
-
-                if (j.count("steps")) {
-                    for (auto& j_step : j["steps"])
-                    {
-                        // flags
-
-                        Step::Flags flags;
-
-                        if (j_step.count("flags")) {
-                            for (auto& j_flag : j_step["flags"])
-                            {
-                                const std::string flagName = utils::tolower( j_flag.get<std::string>() );
-
-                                if (flagName == "always")    flags |= Step::Flag::Always;
-                                else if (flagName == "sudo") flags |= Step::Flag::Sudo;
-                            }
-                        }
-
-                        //
-
-                        Step& newStep = *new Step(j_step["name"],
-                                                  script,
-                                                  flags);
-
-                        script.add(unique_step_t(&newStep));
-
-                        //
-
-                        // artifact links
-
-                        if (j_step.count("artifacts") > 0)
-                        {
-                            for (const auto& artIter : j_step["artifacts"].items())
-                            {
-                                std::string artifactName = artIter.key();
-                                const json& j_artLinkType = artIter.value();
-
-                                if (artifactName[0] == '/') {
-                                    artifactName.erase(0, 1);
-                                }
-                                else {
-                                    artifactName = scriptName + '/' + artifactName;
-                                }
-
-                                //
-
-                                newStep.addArtifactLink(artifactName,
-                                                        Step::ArtifactLink::parse(j_artLinkType.get<std::string>()));
-                            }
-                        }
+            script.applyChildren(lambdaVisitor([this, &scriptName] (Step& step)
+                                               {
+                                                   restore(step, scriptName + ' ' + step.name());
+                                               }));
+        }
 
-                        // dependencies
+    private:
+        const CacheSnapshot& m_snapshot;
+        mutable std::vector<CacheSnapshot::SavedDependency> m_dependencies;
+        mutable SavedStep m_saved;
 
-                        loadDependencies(m_master, j_step, newStep, scriptName);
-                    }
-                }
-            }
-            catch (std::exception& e) {
-                throw std::runtime_error(({
-                            std::ostringstream oss;
-                            oss << scriptName << " : " << e.what();
-                            oss.str();
-                        }));
-            }
-        }
+        //
 
-        static void loadDependencies(Master& master, const json& j, Step& step, const std::string& baseName)
+        void restore(Step& step, const std::string& stepName) const
         {
-            if (j.count("dependencies") <= 0) {
+            if (!m_snapshot.findStep(stepName, m_saved.completed, m_dependencies)) {
                 return;
             }
 
-            for (auto& j_dep : j["dependencies"])
-            {
-                const std::string type = j_dep["type"].get<std::string>();
-
-                if (type == "artifact") {
-                    std::string artifactName = j_dep["id"].get<std::string>();
+            // the last of duplicate entries wins, as it always has
 
-                    if (artifactName[0] == '/') {
-                        artifactName.erase(0, 1);
-                    }
-                    else {
-                        artifactName = baseName + '/' + artifactName;
-                    }
+            m_saved.hashes.clear();
 
-                    step.addDependency(std::make_unique<DependencyArtifact>(master,
-                                                                            artifactName));
-                }
-                else if (type == "data") {
-                    step.addDependency(std::make_unique<DependencyData>(j_dep["id"].get<std::string>(),
-                                                                        j_dep["data"].get<std::string>()));
-                }
-                else if (type == "file") {
-                    step.addDependency(std::make_unique<DependencyFile>(j_dep["id"].get<std::string>(),
-                                                                        j_dep["path"].get<std::string>()));
-                }
+            for (const auto& dep : m_dependencies) {
+                m_saved.hashes[dependencyKey(dep.type, dep.id)] = dep.hash;
             }
-        }
 
-    private:
-        Master& m_master;
+            restoreStep(step, stepName, m_saved);
+        }
+    };
 
-        //
+    // steps.json of older versions, indexed in one pass over the document
 
-        void parseArtifacts(const json& j,
-                            const std::string& unitName) const
+    class load_legacy_step_cache : public Unit::Visitor {
+    public:
+        load_legacy_step_cache(const json& j)
         {
-            if (j.count("artifacts") <= 0)
+            if (!j.is_object()) {
                 return;
+            }
+
+            m_steps.reserve(j.size());
 
-            for (auto& j_art : j["artifacts"].items())
+            for (const auto& j_pair : j.items())
             {
-                const std::string& key = j_art.key();
-                const json& value = j_art.value();
+                const json& j_step = j_pair.value();
 
-                //
+                if (!j_step.is_object()) {
+                    continue;
+                }
 
-                const std::string artifactName = ( !unitName.empty()
-                                                   ? unitName + '/' + key
-                                                   : key );
+                SavedStep& saved = m_steps[j_pair.key()];
 
-                const std::string type = value["type"].get<std::string>();
-                const std::string path = value["path"].get<std::string>();
+                const auto j_completed = j_step.find("completed");
 
-                Artifact* artifact = nullptr;
+                saved.completed = (j_completed != j_step.end()
+                                   && j_completed->is_boolean()
+                                   && j_completed->get<bool>());
 
-                if (type == "file")
+                const auto j_deps = j_step.find("dependencies");
+
+                if (j_deps == j_step.end()
+                    || !j_deps->is_array())
                 {
-                    artifact = new ArtifactFile(artifactName,
-                                                unitName,
-                                                path);
+                    continue;
                 }
-                else if (type == "directory")
-                {
-                    std::vector<std::string> excludeDirs;
 
-                    if (value.count("exclude") > 0) {
-                        for (const auto& ex : value["exclude"]) {
-                            excludeDirs.push_back(ex.get<std::string>());
-                        }
+                for (const json& j_dep : *j_deps)
+                {
+                    if (!j_dep.is_object()) {
+                        continue;
                     }
 
-                    artifact = new ArtifactDir(artifactName,
-                                               unitName,
-                                               path,
-                                               std::move( excludeDirs ));
-                }
-
-                m_master.artifacts.emplace(artifactName,
-                                           unique_artifact_t(artifact));
-            }
-        }
-
-        void parseRules(Group& group, const std::string& groupName, const json& j) const
-        {
-            if (j.count("rules") <= 0) {
-                return;
-            }
+                    const auto j_id   = j_dep.find("id");
+                    const auto j_type = j_dep.find("type");
+                    const auto j_hash = j_dep.find("hash");
 
-            for (auto& j_rule : j["rules"].items())
-            {
-                const std::string& stepName = j_rule.key();
-                const json& j_stepRules = j_rule.value();
-
-                // "dependencies"
+                    if (j_id == j_dep.end() || !j_id->is_string()
+                        || j_type == j_dep.end() || !j_type->is_string()
+                        || j_hash == j_dep.end() || !j_hash->is_string())
+                    {
+                        continue;
+                    }
 
-                if (j_stepRules.count("dependencies"))
-                {
-                    group.apply(travelers::ForEach(lambdaVisitor([&master = m_master, &stepName, &groupName, &j_stepRules]
-                                                                 (Step& step)
-                                                                 {
-                                                                     if (step.name() == stepName) {
-                                                                         loadDependencies(master, j_stepRules, step, groupName);
-                                                                     }
-                                                                 })));
+                    saved.hashes[dependencyKey(j_type->get_ref<const std::string&>(),
+                                               j_id->get_ref<const std::string&>())]
+                        = hashing::Digest::parse(j_hash->get_ref<const std::string&>());
                 }
             }
         }
 
-        static json execSwdInfo(const std::string& execFile)
-        {
-            const std::string execCommand = execFile + " swd_info";
-            utils::Exec execSwdInfo(execCommand);
-
-            std::stringstream ssSwdInfo;
-            ssSwdInfo << execSwdInfo.read().rdbuf();
-
-            if (!execSwdInfo.wait()) {
-                throw std::runtime_error("exec failed: " + execCommand);
-            }
-
-            json j;
-            ssSwdInfo >> j;
-            return j;
-        }
-    };
-
-    // -----
-
-    class load_step_cache : public Unit::Visitor {
-    public:
-        load_step_cache(const json& j)
-            : m_json(j) {}
-
-        void operator() (Step& step) const override
+        void operator() (Script& script) const override
         {
-            const std::string stepName = tools::conjurePath(step);
-
-            const json& j_step = ({
-                    auto iter = m_json.find(stepName);
-                    if (iter == m_json.end()) {
-                        return;
-                    }
-                    *iter;
-                });
-
-            // completed
-
-            if (j_step.count("completed") > 0
-                && j_step["completed"].is_boolean()
-                && j_step["completed"])
-            {
-                try {
-                    step.complete();
-                } catch (std::runtime_error& ex) {
-                    std::cout << "Failing to complete step '" << stepName << "' because: " << ex.what() << std::endl;
-                }
+            if (m_steps.empty()) {
+                return;
             }
 
-            // dependencies
-
-            if (j_step.count("dependencies") > 0
-                && j_step["dependencies"].is_array())
-            {
-                const json& j_deps = j_step["dependencies"];
+            const std::string scriptName = tools::conjurePath(script);
 
-                step.forEachDependency([&j_deps] (Dependency& dep)
-                                       {
-                                           for (auto j_iter = j_deps.begin();
-                                                j_iter != j_deps.end();
-                                                ++j_iter)
-                                           {
-                                               if (!j_iter->is_object()) {
-                                                   continue;
-                                               }
-
-                                               if (dep.id() == (*j_iter)["id"]
-                                                   && dep.type() == (*j_iter)["type"]
-                                                   && j_iter->count("hash"))
+            script.applyChildren(lambdaVisitor([this, &scriptName] (Step& step)
                                                {
-                                                   dep.storeHash((*j_iter)["hash"]);
-                                               }
-                                           }
-                                       });
-            }
+                                                   const std::string stepName = scriptName + ' ' + step.name();
+                                                   const auto iter = m_steps.find(stepName);
+
+                                                   if (iter != m_steps.end()) {
+                                                       restoreStep(step, stepName, iter->second);
+                                                   }
+                                               }));
         }
 
     private:
-        const json& m_json;
+        std::unordered_map<std::string, SavedStep> m_steps;
     };
 }
 
 //
 
-void tools::loadScriptConfig(Master& master, Unit& unit)
+void tools::loadScriptCache(Unit& unit, const CacheSnapshot& snapshot)
 {
-    unit.apply(load_basics(master));
-
-    //
+    if (snapshot.isOpen()) {
+        unit.apply(travelers::ForEach(load_step_cache(snapshot)));
+    }
+}
 
-    std::ifstream ifs(stepCacheFileName());
+void tools::loadLegacyScriptCache(Unit& unit)
+{
+    std::ifstream ifs(CacheSnapshot::legacyStepsFileName());
 
     if (!ifs) {
         std::cout << "Step cache file does not exist." << std::endl;
@@ -460,88 +313,48 @@ void tools::loadScriptConfig(Master& master, Unit& unit)
 
     //
 
-    unit.apply(travelers::ForEach(load_step_cache(j)));
+    unit.apply(travelers::ForEach(load_legacy_step_cache(j)));
 }
 
 // ------------------------------------------------------------
 
-void to_json(json& j, const Dependency& dep)
-{
-    j = json{
-        { "hash", dep.getHashSum() },
-        { "id",   dep.id()         },
-        { "type", dep.type()       }
-    };
-}
-
-// -----
-
 namespace
 {
-    class conjure_step_cache_json : public Unit::Visitor {
+    class conjure_step_cache : public Unit::Visitor {
     public:
+        conjure_step_cache(CacheSnapshot::Writer& writer)
+            : m_writer(writer) {}
+
         void operator() (Step& step) const override
         {
-            const std::string stepName = tools::conjurePath(step);
-
-            // completed
+            std::vector<CacheSnapshot::SavedDependency> dependencies;
 
-            if (step.isCompleted()) {
-                m_json[stepName]["completed"] = true;
-            }
-
-            // dependencies
-
-            json j_deps = json::array();
-            bool didSomething = false;
-
-            step.forEachDependency([&j_deps, &didSomething] (Dependency& dep)
+            step.forEachDependency([&dependencies] (Dependency& dep)
                                    {
-                                       j_deps.push_back(dep);
-                                       didSomething = true;
+                                       dependencies.push_back(CacheSnapshot::SavedDependency{ dep.id(),
+                                                                                              dep.type(),
+                                                                                              dep.storedDigest() });
                                    });
 
-            if (didSomething) {
-                m_json[stepName]["dependencies"] = j_deps;
+            if (step.isCompleted()
+                || !dependencies.empty())
+            {
+                m_writer.addStep(tools::conjurePath(step),
+                                 step.isCompleted(),
+                                 dependencies);
             }
         }
 
-        const json& getJson() const
-        {
-            return m_json;
-        }
-
     private:
-        mutable json m_json;
+        CacheSnapshot::Writer& m_writer;
     };
 }
 
 //
 
-void tools::saveScriptCache(Unit& unit)
+void tools::saveScriptCache(Unit& unit, CacheSnapshot::Writer& writer)
 {
-    conjure_step_cache_json conjurer;
-
-    unit.apply(travelers::ForEach(conjurer));
-
-    //
-
-    const std::string fileName = stepCacheFileName();
-    const std::string tmpName = fileName + ".tmp";
-
-    std::ofstream ofs(tmpName);
-
-    if (!ofs) {
-        throw std::runtime_error("failed to open step cache file: " + tmpName);
-    }
-
-    if (!(ofs << conjurer.getJson().dump(1, '\t') << std::endl)) {
-        throw std::runtime_error("failed to save step JSON data");
-    }
-
-    if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
-        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + fileName + "'");
-    }
+    unit.apply(travelers::ForEach(conjure_step_cache(writer)));
 }
 
 // ------------------------------------------------------------
@@ -556,11 +369,13 @@ namespace
         scoped_execute(Master& master,
                        int iterationLimit,
                        bool showNext,
-                       bool interactive)
+                       bool interactive,
+                       const std::set<Step*>* only)
             : m_master(master),
               m_iterationLimit(iterationLimit),
               m_showNext(showNext),
-              m_interactive(interactive) {}
+              m_interactive(interactive),
+              m_only(only) {}
 
         void operator() (Group& group) const override
         {
@@ -610,7 +425,9 @@ namespace
 
         void operator() (Step& step) const override
         {
-            if (m_iterationLimit == 0) {
+            if (m_iterationLimit == 0
+                || (m_only && m_only->count(&step) == 0))
+            {
                 return;
             }
 
@@ -624,6 +441,11 @@ namespace
                     return;
                 }
 
+                // what the steps before have journaled is not left to wait
+                // for the next record
+
+                CacheJournal::instance().sync();
+
                 if (m_interactive) {
                     std::cout << utils::ansi::Bold
                               << utils::ansi::Green << "exec '"
@@ -655,8 +477,7 @@ namespace
                     }
                 }
 
-                doExecute(m_master,
-                          step);
+                doExecute(step);
 
                 //
 
@@ -668,8 +489,7 @@ namespace
 
         //
 
-        static void doExecute(Master& master,
-                              Step& step)
+        void doExecute(Step& step) const
         {
             const auto& conf = Config::instance();
 
@@ -677,6 +497,24 @@ namespace
                 throw std::runtime_error("INTERRUPTED");
             }
 
+            const bool success = ((!conf.step_zygote.empty()
+                                   && !step.flag(Step::Flag::Sudo))
+                                  ? runInZygote(step)
+                                  : runProcess(step))
+                && !conf.interrupted;
+
+            step.recalculateHashes(m_master);
+
+            if (success) {
+                step.complete();
+            }
+            else {
+                throw std::runtime_error("step '" + tools::conjureExec(step) + "' failed");
+            }
+        }
+
+        static bool runProcess(Step& step)
+        {
             const std::string command = ({
                     std::ostringstream oss;
 
@@ -693,17 +531,24 @@ namespace
 
             std::cout << process.read().rdbuf();
 
-            const bool success = (process.wait()
-                                  && !conf.interrupted);
+            return process.wait();
+        }
 
-            step.recalculateHashes(master);
+        bool runInZygote(Step& step) const
+        {
+            // steps of a script come one after another, so one worker at a
+            // time is enough
 
-            if (success) {
-                step.complete();
-            }
-            else {
-                throw std::runtime_error("step '" + tools::conjureExec(step) + "' failed");
+            const std::string scriptExec = tools::conjureExec(*step.parent());
+
+            if (!m_zygote
+                || m_zygote->scriptExec() != scriptExec)
+            {
+                m_zygote.reset();
+                m_zygote = std::make_unique<StepZygote>(scriptExec);
             }
+
+            return m_zygote->run(step.name());
         }
 
     private:
@@ -711,7 +556,69 @@ namespace
         mutable int m_iterationLimit;
         bool m_showNext;
         bool m_interactive;
+        const std::set<Step*>* m_only;
+        mutable std::unique_ptr<StepZygote> m_zygote;
     };
+
+    // the steps 'unit' needs run: its own and those before them in their
+    // scripts, and likewise the steps producing the artifacts these depend
+    // on
+
+    std::set<Step*> upstreamSteps(Master& master, Unit& unit)
+    {
+        std::vector<Step*> loaded;
+
+        master.root->apply(travelers::ForEach(lambdaVisitor([&loaded] (Step& step) { loaded.push_back(&step); })));
+
+        std::set<Step*> wanted;
+        std::vector<Step*> pending;
+
+        const auto want = [&wanted, &pending] (Step& step)
+            {
+                bool passed = false;
+
+                step.parent()->applyChildren(lambdaVisitor([&wanted, &pending, &step, &passed] (Step& before)
+                                                           {
+                                                               if (!passed
+                                                                   && wanted.insert(&before).second)
+                                                               {
+                                                                   pending.push_back(&before);
+                                                               }
+
+                                                               passed = passed || &before == &step;
+                                                           }));
+            };
+
+        unit.apply(travelers::ForEach(lambdaVisitor(want)));
+
+        //
+
+        std::set<std::string> artifacts;
+
+        while (!pending.empty())
+        {
+            Step& step = *pending.back();
+            pending.pop_back();
+
+            step.forEachDependency([&loaded, &artifacts, &want] (Dependency& dep)
+                                   {
+                                       if (dep.type() != "artifact"
+                                           || !artifacts.insert(dep.id()).second)
+                                       {
+                                           return;
+                                       }
+
+                                       for (Step* producer : loaded)
+                                       {
+                                           if (producer->hasArtifactLink(dep.id())) {
+                                               want(*producer);
+                                           }
+                                       }
+                                   });
+        }
+
+        return wanted;
+    }
 }
 
 //
@@ -719,7 +626,8 @@ namespace
 void tools::execute(Master& master,
                     int stepCount,
                     bool showNext,
-                    bool interactive)
+                    bool interactive,
+                    Unit* target)
 {
     const int modeCount = ((showNext         ? 1 : 0)
                            + (stepCount > -1 ? 1 : 0)
@@ -729,7 +637,15 @@ void tools::execute(Master& master,
         throw std::runtime_error("tools::execute(): too many main functions");
     }
 
-    master.root->apply( scoped_execute(master, stepCount, showNext, interactive) );
+    if (target)
+    {
+        const std::set<Step*> only = upstreamSteps(master, *target);
+
+        master.root->apply( scoped_execute(master, stepCount, showNext, interactive, &only) );
+    }
+    else {
+        master.root->apply( scoped_execute(master, stepCount, showNext, interactive, nullptr) );
+    }
 }
 
 // ------------------------------------------------------------
@@ -760,6 +676,91 @@ void tools::listSteps(Unit& unit, std::ostream& out)
 
 // ------------------------------------------------------------
 
+namespace
+{
+    class step_status : public Unit::Visitor {
+    public:
+        step_status(std::ostream& out)
+            : m_out(out) {}
+
+        void operator() (Step& step) const override
+        {
+            namespace col = utils::ansi;
+            //
+
+            m_out << tools::conjurePath(step) << " : ";
+
+            if (!step.isCompleted())
+            {
+                m_out << col::Bold << col::Black
+                      << "Incomplete"
+                      << col::Normal;
+            }
+            else if (step.flag(Step::Flag::Always))
+            {
+                m_out << col::Bold << col::Cyan
+                      << "Always"
+                      << col::Normal;
+            }
+            else {
+                bool dirty = false;
+                bool modified = false;
+
+                step.forEachDependency([&dirty, &modified] (Dependency& dep)
+                                       {
+                                           const std::string hashSum = dep.probeHash();
+
+                                           if (hashSum.empty()) {
+                                               modified = true;
+                                           }
+                                           else if (!dep.matchesHash(hashSum)) {
+                                               dirty = true;
+                                           }
+                                       });
+
+                if (dirty)
+                {
+                    m_out << col::Bold << col::Red
+                          << "Dirty"
+                          << col::Normal;
+                }
+                else if (modified)
+                {
+                    m_out << col::Bold << col::Yellow
+                          << "Modified"
+                          << col::Normal;
+                }
+                else {
+                    m_out << col::Bold << col::Green
+                          << "Up to date"
+                          << col::Normal;
+                }
+            }
+
+            m_out << '\n';
+        }
+
+    private:
+        std::ostream& m_out;
+    };
+}
+
+//
+
+void tools::status(Master& master, std::ostream& out)
+{
+    namespace col = utils::ansi;
+    //
+
+    out << col::Bold << "Steps:" << col::Normal << '\n';
+    master.root->apply(travelers::ForEach(step_status(out)));
+
+    out << '\n' << col::Bold << "Artifacts:" << col::Normal << '\n';
+    tools::artifactStatus(master, out);
+}
+
+// ------------------------------------------------------------
+
 namespace
 {
     class undo_step : public Unit::Visitor {
@@ -9,6 +9,8 @@
 #include <iosfwd>
 #include <string>
 
+#include "cache-snapshot.hh"
+
 // forward declarations
 
 class Master;
@@ -20,12 +22,17 @@ namespace tools
 {
     std::string conjurePath(Unit& unit);
     std::string conjureExec(Unit& unit);
-    void loadScriptConfig(Master& master, Unit& unit);
 
-    void saveScriptCache(Unit& unit);
+    void loadScriptCache(Unit& unit, const CacheSnapshot& snapshot);
+    void loadLegacyScriptCache(Unit& unit);
+    void saveScriptCache(Unit& unit, CacheSnapshot::Writer& writer);
+
+    // 'target', if given, limits execution to the steps it needs run: its
+    // own and those upstream of it
 
-    void execute(Master& master, int stepCount, bool showNext, bool interactive);
+    void execute(Master& master, int stepCount, bool showNext, bool interactive, Unit* target = nullptr);
     void listSteps(Unit& unit, std::ostream& out);
+    void status(Master& master, std::ostream& out);
 
     void undo(Master& master, const std::string& stepName);
 
@@ -6,6 +6,8 @@
 
 #include "script.hh"
 
+#include "cache-journal.hh"
+#include "hash-batch.hh"
 #include "master.hh"
 #include "script-tools.hh"
 
@@ -153,6 +155,7 @@ void Script::completeStep(const std::string& stepName)
         if (step->name() == stepName)
         {
             step->m_completed = true;
+            m_cacheDirty = true;
             matchFound = true;
             continue;
         }
@@ -180,6 +183,7 @@ void Script::undoStep(const std::string& stepName)
 
         if (matchFound) {
             step->m_completed = false;
+            m_cacheDirty = true;
         }
     }
 }
@@ -190,6 +194,20 @@ void Script::undoAllSteps()
     {
         step->m_completed = false;
     }
+
+    m_cacheDirty = true;
+
+    CacheJournal::instance().scriptUndone(*this);
+}
+
+bool Script::isCacheDirty() const
+{
+    return m_cacheDirty;
+}
+
+void Script::setCacheDirty(bool dirty)
+{
+    m_cacheDirty = dirty;
 }
 
 void Script::add(unique_step_t&& step)
@@ -197,6 +215,11 @@ void Script::add(unique_step_t&& step)
     m_steps.emplace_back(std::move(step));
 }
 
+void Script::clear()
+{
+    m_steps.clear();
+}
+
 void Script::apply(const Visitor& visitor)
 {
     visitor(*this);
@@ -250,11 +273,15 @@ bool Step::isCompleted() const
 void Step::complete()
 {
     m_parent->completeStep(name());
+
+    CacheJournal::instance().stepCompleted(*this);
 }
 
 void Step::undo()
 {
     m_parent->undoStep(name());
+
+    CacheJournal::instance().stepUndone(*this);
 }
 
 bool Step::hasArtifactLink(const std::string& artifactName)
@@ -302,12 +329,28 @@ bool Step::everythingUpToDate(Master& master)
     bool upToDateSoFar = ( !flag(Flag::Always)
                            && isCompleted() );
 
-    if (upToDateSoFar) {
-        for (auto& d : m_dependencies) {
-            if (!d->isUpToDate()) {
+    if (upToDateSoFar)
+    {
+        std::vector<const HashCache*> dependencies;
+
+        for (const auto& d : m_dependencies) {
+            dependencies.push_back(d.get());
+        }
+
+        const auto hashSums = tools::calculateHashes(dependencies);
+
+        for (std::size_t i = 0; i < m_dependencies.size(); ++i)
+        {
+            const hashing::Digest baseline = m_dependencies[i]->storedDigest();
+
+            if (!m_dependencies[i]->compareHash(hashSums[i])) {
                 upToDateSoFar = false;
                 break;
             }
+
+            if (m_dependencies[i]->storedDigest() != baseline) {
+                m_parent->setCacheDirty();      // rebaselined
+            }
         }
     }
 
@@ -340,9 +383,13 @@ void Step::recalculateHashes(Master& master)
                               pair.type);
     }
 
+    m_parent->setCacheDirty();
+
     for (auto& d : m_dependencies)
     {
         d->storeHash( d->calculateHash() );
+
+        CacheJournal::instance().dependencyStored(stepName, *d);
     }
 }
 
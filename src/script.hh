@@ -134,7 +134,14 @@ public:
     void undoStep(const std::string&);
     void undoAllSteps();
 
+    // set when the saved state of the steps changes, so that only changed
+    // scripts are saved
+
+    bool isCacheDirty() const;
+    void setCacheDirty(bool dirty = true);
+
     void add(unique_step_t&& step);
+    void clear();           // before loading the script again
 
     void apply(const Visitor& visitor) override;
     void applyChildren(const Visitor& visitor) override;
@@ -144,6 +151,7 @@ public:
 private:
     Group* m_parent = nullptr;
     std::vector<unique_step_t> m_steps;
+    bool m_cacheDirty = false;
 };
 
 // -----
@@ -175,6 +183,7 @@ public:
     void undo();
 
     bool hasArtifactLink(const std::string& artifactName);
+    const std::vector<ArtifactLink>& artifactLinks() const { return m_artifacts; }
     void addArtifactLink(const std::string& artifactName,
                          ArtifactLink::Type pointerType);
     void addDependency(unique_dependency_t&& dependency);
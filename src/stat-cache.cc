@@ -0,0 +1,254 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "stat-cache.hh"
+
+#include "config.hh"
+#include "utils/path.hh"
+
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+//
+
+namespace
+{
+    const std::string Magic = "swd-stat-cache";
+    const int Version = 1;
+
+    // mtime/ctime closer than this to the moment of hashing make a digest
+    // racy; generous enough for filesystems with 1-2 second timestamps
+
+    const int64_t RacyWindow = 2 * int64_t(1000000000);
+
+    std::string statCacheFileName()
+    {
+        return Config::instance().cache_dir + "/stat-cache";
+    }
+
+    // digests depend on these settings, so the cache is dropped if they
+    // change
+
+    std::string configSignature()
+    {
+        const auto& conf = Config::instance();
+        std::ostringstream oss;
+
+        oss << (conf.hash_bin.empty() ? conf.hash_algo : conf.hash_bin)
+            << ',' << conf.hash_tree_threshold;
+
+        return oss.str();
+    }
+}
+
+// ------------------------------------------------------------
+
+StatCache::Key StatCache::Key::fromStat(const struct stat& st)
+{
+    return Key{
+        uint64_t(st.st_dev),
+        uint64_t(st.st_ino),
+        uint64_t(st.st_size),
+        int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec,
+        int64_t(st.st_ctim.tv_sec) * 1000000000 + st.st_ctim.tv_nsec,
+    };
+}
+
+bool StatCache::Key::operator== (const Key& other) const
+{
+    return dev == other.dev
+        && ino == other.ino
+        && size == other.size
+        && mtime == other.mtime
+        && ctime == other.ctime;
+}
+
+// ------------------------------------------------------------
+
+bool StatCache::lookup(const std::string& path, const Key& key, std::string& digest) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto iter = m_entries.find(path);
+
+    if (iter == m_entries.end()) {
+        return false;
+    }
+
+    const Entry& entry = iter->second;
+
+    if (!(entry.key == key)) {
+        return false;       // left to save() to drop if not stored again
+    }
+
+    entry.used = true;
+
+    if (!settled(entry.key, entry.hashedAt)) {
+        return false;
+    }
+
+    digest = entry.digest;
+    return true;
+}
+
+void StatCache::store(const std::string& path, const Key& key, int64_t hashedAt, const std::string& digest)
+{
+    if (path.find('\n') != std::string::npos) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_entries[path] = Entry{ key, hashedAt, digest, true };
+    m_dirty = true;
+}
+
+void StatCache::save()
+{
+    if (!m_dirty) {
+        return;
+    }
+
+    utils::safeMkdir(Config::instance().cache_dir);
+
+    // unused entries are checked against their files; the used ones
+    // matched them, or were just stored
+
+    for (auto iter = m_entries.begin(); iter != m_entries.end(); )
+    {
+        struct stat st;
+
+        if (!iter->second.used
+            && (stat(iter->first.c_str(), &st) != 0
+                || !(Key::fromStat(st) == iter->second.key)))
+        {
+            iter = m_entries.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+
+    //
+
+    const std::string fileName = statCacheFileName();
+    const std::string tmpName = fileName + ".tmp";
+
+    std::ofstream ofs(tmpName);
+
+    if (!ofs) {
+        throw std::runtime_error("failed to open stat cache file: " + tmpName);
+    }
+
+    ofs << Magic << ' ' << Version << ' ' << configSignature() << '\n';
+
+    for (const auto& pair : m_entries)
+    {
+        const Entry& e = pair.second;
+
+        ofs << e.key.dev << ' ' << e.key.ino << ' ' << e.key.size << ' '
+            << e.key.mtime << ' ' << e.key.ctime << ' '
+            << e.hashedAt << ' ' << e.digest << ' ' << pair.first << '\n';
+    }
+
+    if (!(ofs << std::flush)) {
+        throw std::runtime_error("failed to save stat cache");
+    }
+
+    if (rename(tmpName.c_str(), fileName.c_str()) != 0) {
+        throw std::runtime_error("failed to rename '" + tmpName + "' over '" + fileName + "'");
+    }
+
+    m_dirty = false;
+}
+
+bool StatCache::settled(const Key& key, int64_t hashedAt)
+{
+    return (settled(key.mtime, hashedAt)
+            && settled(key.ctime, hashedAt));
+}
+
+bool StatCache::settled(int64_t timestamp, int64_t hashedAt)
+{
+    return timestamp + RacyWindow < hashedAt;
+}
+
+int64_t StatCache::now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+StatCache& StatCache::instance()
+{
+    static StatCache s_statCache;
+    return s_statCache;
+}
+
+void StatCache::load()
+{
+    std::ifstream ifs(statCacheFileName());
+
+    if (!ifs) {
+        return;
+    }
+
+    // header
+
+    {
+        std::string line;
+        std::string magic;
+        int version = 0;
+        std::string signature;
+
+        if (!getline(ifs, line)) {
+            return;
+        }
+
+        // the signature is the rest of the line, as hash_bin may have spaces
+
+        std::istringstream iss(line);
+
+        if (!(iss >> magic >> version >> std::ws)
+            || !getline(iss, signature)
+            || magic != Magic
+            || version != Version
+            || signature != configSignature())
+        {
+            return;     // stale or foreign: start over
+        }
+    }
+
+    // entries
+
+    Entry e;
+    std::string path;
+
+    e.used = false;
+
+    while (ifs >> e.key.dev >> e.key.ino >> e.key.size
+           >> e.key.mtime >> e.key.ctime
+           >> e.hashedAt >> e.digest
+           && ifs.get() == ' '
+           && getline(ifs, path))
+    {
+        m_entries[path] = e;
+    }
+}
+
+StatCache::StatCache()
+{
+    load();
+}
+
+StatCache::~StatCache() = default;
@@ -0,0 +1,79 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+struct stat;
+
+//
+
+// Digests of files keyed by their stat data, persisted in cache_dir like
+// git's index: as long as (device, inode, size, mtime, ctime) of a path are
+// unchanged, its previous digest is returned without reading the file.
+//
+// A digest is trusted only if the file's timestamps are older than the
+// moment it was hashed by more than the timestamp granularity of common
+// filesystems. Files modified "at the same time" as they were hashed are
+// racy and get reread until they have settled.
+//
+// lookup() and store() may be called from several threads.
+//
+// save() drops the entries that were not used in the run if their file
+// has gone or changed since, as they could never match again.
+
+class StatCache {
+public:
+    struct Key {
+        uint64_t dev;
+        uint64_t ino;
+        uint64_t size;
+        int64_t mtime;
+        int64_t ctime;
+
+        static Key fromStat(const struct stat& st);
+
+        bool operator== (const Key& other) const;
+    };
+
+    //
+
+    bool lookup(const std::string& path, const Key& key, std::string& digest) const;
+    void store(const std::string& path, const Key& key, int64_t hashedAt, const std::string& digest);
+
+    void save();
+
+    //
+
+    static bool settled(const Key& key, int64_t hashedAt);     // not racy
+    static bool settled(int64_t timestamp, int64_t hashedAt);
+    static int64_t now();
+
+    static StatCache& instance();
+
+private:
+    struct Entry {
+        Key key;
+        int64_t hashedAt;
+        std::string digest;
+        mutable bool used;          // looked up or stored in this run
+    };
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    bool m_dirty = false;
+
+    //
+
+    void load();
+
+    StatCache();
+    ~StatCache();
+};
@@ -0,0 +1,84 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "step-zygote.hh"
+
+#include "config.hh"
+#include "utils/exec.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+//
+
+namespace
+{
+    const std::string Handshake = "swd-zygote 1";
+}
+
+// ------------------------------------------------------------
+
+StepZygote::StepZygote(const std::string& scriptExec)
+    : m_scriptExec(scriptExec)
+{
+    // unlike the pipes of utils::Exec, a dup() is inherited over exec
+
+    const int outFd = dup(STDOUT_FILENO);
+
+    if (outFd < 0) {
+        throw std::runtime_error(std::string("dup: ") + strerror(errno));
+    }
+
+    try {
+        m_worker = std::make_unique<utils::Exec>(Config::instance().step_zygote
+                                                 + ' ' + m_scriptExec
+                                                 + ' ' + std::to_string(outFd));
+    }
+    catch (...) {
+        close(outFd);
+        throw;
+    }
+
+    close(outFd);
+
+    // a worker that fails to load the script has quit by now, and must
+    // not be written to
+
+    std::string line;
+
+    if (!getline(m_worker->read(), line)
+        || line != Handshake)
+    {
+        throw std::runtime_error("step worker failed to start: " + Config::instance().step_zygote + ' ' + m_scriptExec);
+    }
+}
+
+StepZygote::~StepZygote()
+{
+    m_worker->close_write();
+    m_worker->wait();
+}
+
+bool StepZygote::run(const std::string& stepName)
+{
+    std::cout.flush();
+
+    m_worker->write() << stepName << std::endl;
+
+    std::string line;
+
+    if (!m_worker->write()
+        || !getline(m_worker->read(), line))
+    {
+        throw std::runtime_error("step worker quit: " + Config::instance().step_zygote + ' ' + m_scriptExec);
+    }
+
+    return line == "0";
+}
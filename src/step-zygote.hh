@@ -0,0 +1,49 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+// forward declarations
+
+namespace utils
+{
+    class Exec;
+}
+
+//
+
+// Long-lived worker that runs the steps of one script, for "step_zygote
+// <worker>" in .swd.conf. The worker is started as
+//
+//     <worker> <script> <fd>
+//
+// sources the script once and answers "swd-zygote 1" when ready. It then
+// reads one step name per line, runs the step in a subshell of itself
+// with its output going to <fd> (the stdout of swd), and answers with the
+// step's exit status. Stdin and stdout of the worker are only used for
+// this exchange. include/tr_zygote.sh in the test tree is the worker for
+// scripts run through tr_exec.sh.
+
+class StepZygote {
+public:
+    StepZygote(const std::string& scriptExec);
+    ~StepZygote();
+
+    const std::string& scriptExec() const { return m_scriptExec; }
+
+    bool run(const std::string& stepName);
+
+private:
+    const std::string m_scriptExec;
+    std::unique_ptr<utils::Exec> m_worker;
+
+    //
+
+    StepZygote(const StepZygote&) = delete;
+};
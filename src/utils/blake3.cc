@@ -0,0 +1,300 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "blake3.hh"
+
+#include "string.hh"
+
+#include <algorithm>
+#include <cstring>
+
+//
+
+namespace
+{
+    const uint32_t IV[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    const uint8_t MsgPermutation[16] = { 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 };
+
+    const uint32_t ChunkStart = 1 << 0;
+    const uint32_t ChunkEnd   = 1 << 1;
+    const uint32_t Parent     = 1 << 2;
+    const uint32_t Root       = 1 << 3;
+
+    inline uint32_t rotr(uint32_t x, unsigned int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    inline uint32_t loadLE32(const uint8_t* p)
+    {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    inline void storeLE32(uint8_t* p, uint32_t v)
+    {
+        p[0] = uint8_t(v);
+        p[1] = uint8_t(v >> 8);
+        p[2] = uint8_t(v >> 16);
+        p[3] = uint8_t(v >> 24);
+    }
+
+    inline void g(uint32_t s[16], int a, int b, int c, int d, uint32_t mx, uint32_t my)
+    {
+        s[a] = s[a] + s[b] + mx;
+        s[d] = rotr(s[d] ^ s[a], 16);
+        s[c] = s[c] + s[d];
+        s[b] = rotr(s[b] ^ s[c], 12);
+        s[a] = s[a] + s[b] + my;
+        s[d] = rotr(s[d] ^ s[a], 8);
+        s[c] = s[c] + s[d];
+        s[b] = rotr(s[b] ^ s[c], 7);
+    }
+
+    void compress(const uint32_t cv[8],
+                  const uint8_t block[utils::Blake3::BlockSize],
+                  uint8_t blockLen,
+                  uint64_t counter,
+                  uint32_t flags,
+                  uint32_t out[16])
+    {
+        uint32_t m[16];
+
+        for (int i = 0; i < 16; ++i) {
+            m[i] = loadLE32(block + 4*i);
+        }
+
+        uint32_t s[16] = {
+            cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+            IV[0], IV[1], IV[2], IV[3],
+            uint32_t(counter), uint32_t(counter >> 32), blockLen, flags,
+        };
+
+        for (int round = 0; round < 7; ++round)
+        {
+            g(s, 0, 4,  8, 12, m[0],  m[1]);
+            g(s, 1, 5,  9, 13, m[2],  m[3]);
+            g(s, 2, 6, 10, 14, m[4],  m[5]);
+            g(s, 3, 7, 11, 15, m[6],  m[7]);
+            g(s, 0, 5, 10, 15, m[8],  m[9]);
+            g(s, 1, 6, 11, 12, m[10], m[11]);
+            g(s, 2, 7,  8, 13, m[12], m[13]);
+            g(s, 3, 4,  9, 14, m[14], m[15]);
+
+            if (round < 6)
+            {
+                uint32_t permuted[16];
+
+                for (int i = 0; i < 16; ++i) {
+                    permuted[i] = m[MsgPermutation[i]];
+                }
+
+                memcpy(m, permuted, sizeof(m));
+            }
+        }
+
+        for (int i = 0; i < 8; ++i)
+        {
+            out[i]     = s[i] ^ s[i + 8];
+            out[i + 8] = s[i + 8] ^ cv[i];
+        }
+    }
+
+    void parentCV(const uint32_t left[8], const uint32_t right[8], uint32_t flags, uint32_t out[8])
+    {
+        uint8_t block[utils::Blake3::BlockSize];
+
+        for (int i = 0; i < 8; ++i)
+        {
+            storeLE32(block + 4*i,      left[i]);
+            storeLE32(block + 32 + 4*i, right[i]);
+        }
+
+        uint32_t full[16];
+
+        compress(IV, block, utils::Blake3::BlockSize, 0, Parent | flags, full);
+        memcpy(out, full, 8 * sizeof(uint32_t));
+    }
+}
+
+// ------------------------------------------------------------
+
+void utils::Blake3::ChunkState::reset(uint64_t chunkCounter)
+{
+    memcpy(cv, IV, sizeof(cv));
+    counter = chunkCounter;
+    blockLen = 0;
+    blocksCompressed = 0;
+}
+
+std::size_t utils::Blake3::ChunkState::length() const
+{
+    return std::size_t(BlockSize) * blocksCompressed + blockLen;
+}
+
+void utils::Blake3::ChunkState::update(const uint8_t* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        if (blockLen == BlockSize)
+        {
+            uint32_t out[16];
+
+            compress(cv, block, BlockSize, counter, (blocksCompressed == 0 ? ChunkStart : 0u), out);
+            memcpy(cv, out, sizeof(cv));
+
+            ++blocksCompressed;
+            blockLen = 0;
+        }
+
+        const std::size_t take = std::min<std::size_t>(size, BlockSize - blockLen);
+
+        memcpy(block + blockLen, data, take);
+        blockLen += take;
+        data += take;
+        size -= take;
+    }
+}
+
+// ------------------------------------------------------------
+
+utils::Blake3::Blake3()
+{
+    m_chunk.reset(0);
+}
+
+void utils::Blake3::update(const void* data, std::size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+
+    while (size > 0)
+    {
+        if (m_chunk.length() == ChunkSize)
+        {
+            uint32_t out[16];
+
+            memset(m_chunk.block + m_chunk.blockLen, 0, BlockSize - m_chunk.blockLen);
+            compress(m_chunk.cv, m_chunk.block, m_chunk.blockLen, m_chunk.counter,
+                     ChunkEnd | (m_chunk.blocksCompressed == 0 ? ChunkStart : 0u), out);
+
+            const uint64_t totalChunks = m_chunk.counter + 1;
+
+            addChunkCV(out, totalChunks);
+            m_chunk.reset(totalChunks);
+        }
+
+        const std::size_t take = std::min<std::size_t>(size, ChunkSize - m_chunk.length());
+
+        m_chunk.update(p, take);
+        p += take;
+        size -= take;
+    }
+}
+
+void utils::Blake3::final(uint8_t digest[DigestSize])
+{
+    // output node: the current chunk, folded with the stacked subtrees
+
+    uint32_t inputCV[8];
+    uint8_t block[BlockSize];
+    uint8_t blockLen;
+    uint64_t counter;
+    uint32_t flags;
+
+    memcpy(inputCV, m_chunk.cv, sizeof(inputCV));
+    memset(block, 0, sizeof(block));
+    memcpy(block, m_chunk.block, m_chunk.blockLen);
+    blockLen = m_chunk.blockLen;
+    counter = m_chunk.counter;
+    flags = ChunkEnd | (m_chunk.blocksCompressed == 0 ? ChunkStart : 0u);
+
+    for (int remaining = m_cvStackLen; remaining > 0; --remaining)
+    {
+        uint32_t out[16];
+
+        compress(inputCV, block, blockLen, counter, flags, out);
+
+        for (int i = 0; i < 8; ++i)
+        {
+            storeLE32(block + 4*i,      m_cvStack[remaining - 1][i]);
+            storeLE32(block + 32 + 4*i, out[i]);
+        }
+
+        memcpy(inputCV, IV, sizeof(inputCV));
+        blockLen = BlockSize;
+        counter = 0;
+        flags = Parent;
+    }
+
+    uint32_t out[16];
+
+    compress(inputCV, block, blockLen, counter, flags | Root, out);
+
+    for (int i = 0; i < 8; ++i) {
+        storeLE32(digest + 4*i, out[i]);
+    }
+}
+
+std::string utils::Blake3::hexdigest()
+{
+    uint8_t digest[DigestSize];
+
+    final(digest);
+
+    return toHex(digest, DigestSize);
+}
+
+void utils::Blake3::subtreeCV(const uint8_t* data, uint64_t chunks, uint64_t counter, uint32_t cv[8])
+{
+    Blake3 subtree;
+
+    for (uint64_t i = 0; i < chunks; ++i, data += ChunkSize)
+    {
+        uint32_t out[16];
+
+        subtree.m_chunk.reset(counter + i);
+        subtree.m_chunk.update(data, ChunkSize);
+
+        compress(subtree.m_chunk.cv, subtree.m_chunk.block, subtree.m_chunk.blockLen, subtree.m_chunk.counter,
+                 ChunkEnd, out);
+
+        subtree.addChunkCV(out, i + 1);
+    }
+
+    memcpy(cv, subtree.m_cvStack[0], 8 * sizeof(uint32_t));
+}
+
+void utils::Blake3::addSubtree(const uint32_t cv[8], uint64_t chunks)
+{
+    uint32_t node[8];
+    uint64_t totalChunks = m_chunk.counter + chunks;
+
+    memcpy(node, cv, sizeof(node));
+
+    for (uint64_t total = totalChunks / chunks;
+         (total & 1) == 0;
+         total >>= 1)
+    {
+        parentCV(m_cvStack[--m_cvStackLen], node, 0, node);
+    }
+
+    memcpy(m_cvStack[m_cvStackLen++], node, sizeof(node));
+    m_chunk.reset(totalChunks);
+}
+
+void utils::Blake3::addChunkCV(uint32_t cv[8], uint64_t totalChunks)
+{
+    while ((totalChunks & 1) == 0)
+    {
+        parentCV(m_cvStack[--m_cvStackLen], cv, 0, cv);
+        totalChunks >>= 1;
+    }
+
+    memcpy(m_cvStack[m_cvStackLen++], cv, 8 * sizeof(uint32_t));
+}
@@ -0,0 +1,65 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace utils
+{
+    // Incremental BLAKE3 (unkeyed hash mode, 256-bit output). Portable
+    // implementation following the reference design.
+
+    class Blake3 {
+    public:
+        enum {
+            BlockSize  = 64,
+            ChunkSize  = 1024,
+            DigestSize = 32,
+        };
+
+        //
+
+        Blake3();
+
+        void update(const void* data, std::size_t size);
+        void final(uint8_t digest[DigestSize]);
+
+        std::string hexdigest();
+
+        // Tree access for parallel hashing: the chaining value of a complete
+        // subtree of 'chunks' (a power of two) chunks starting at chunk
+        // 'counter', and appending such a subtree to the hasher. The hasher
+        // must be at a multiple of 'chunks' with no partial chunk buffered,
+        // and more input must follow.
+
+        static void subtreeCV(const uint8_t* data, uint64_t chunks, uint64_t counter, uint32_t cv[8]);
+        void addSubtree(const uint32_t cv[8], uint64_t chunks);
+
+    private:
+        struct ChunkState {
+            uint32_t cv[8];
+            uint64_t counter;
+            uint8_t block[BlockSize];
+            uint8_t blockLen;
+            uint8_t blocksCompressed;
+
+            void reset(uint64_t chunkCounter);
+            std::size_t length() const;
+            void update(const uint8_t* data, std::size_t size);
+        };
+
+        ChunkState m_chunk;
+        uint32_t m_cvStack[54][8];
+        uint8_t m_cvStackLen = 0;
+
+        //
+
+        void addChunkCV(uint32_t cv[8], uint64_t totalChunks);
+    };
+}
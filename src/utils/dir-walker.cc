@@ -0,0 +1,505 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "dir-walker.hh"
+
+#include "parallel.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    struct linux_dirent64 {
+        ino64_t        d_ino;
+        off64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[];
+    };
+
+    bool hasGlob(const std::string& pattern)
+    {
+        return pattern.find_first_of("*?[\\") != std::string::npos;
+    }
+
+    // all names in a directory except "." and "..", sorted
+
+    std::vector<std::string> readNames(int dirFd)
+    {
+        enum { BufferSize = 64 * 1024 };
+        alignas(linux_dirent64) char buffer[BufferSize];
+
+        std::vector<std::string> names;
+
+        for (;;)
+        {
+            const long count = syscall(SYS_getdents64, dirFd, buffer, BufferSize);
+
+            if (count <= 0) {
+                break;
+            }
+
+            for (long offset = 0; offset < count; )
+            {
+                const auto* dirent = reinterpret_cast<const linux_dirent64*>(buffer + offset);
+                const char* name = dirent->d_name;
+
+                if (!(name[0] == '.'
+                      && (name[1] == '\0'
+                          || (name[1] == '.' && name[2] == '\0'))))
+                {
+                    names.emplace_back(name);
+                }
+
+                offset += dirent->d_reclen;
+            }
+        }
+
+        std::sort(names.begin(), names.end());
+
+        return names;
+    }
+
+    inline int64_t nanoseconds(const struct statx_timestamp& ts)
+    {
+        return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    inline uint64_t device(const struct statx& stx)
+    {
+        return makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    }
+
+    utils::DirWalker::Entry makeEntry(const std::string& path, const struct statx& stx)
+    {
+        return utils::DirWalker::Entry{
+            path,
+            stx.stx_size,
+            nanoseconds(stx.stx_mtime),
+            nanoseconds(stx.stx_ctime),
+            device(stx),
+            stx.stx_ino,
+        };
+    }
+
+    // truncates 'path' back to its directory part and appends 'name'
+
+    void setName(std::string& path, std::size_t dirLength, const std::string& name)
+    {
+        path.resize(dirLength);
+
+        if (path.empty()
+            || path.back() != '/')
+        {
+            path += '/';
+        }
+
+        path += name;
+    }
+
+    const unsigned int StatxMask = STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_CTIME | STATX_INO;
+}
+
+// ------------------------------------------------------------
+
+struct utils::DirWalker::Node {
+    struct Record {
+        std::string path;
+        uint64_t size;
+        int64_t mtime;
+        int64_t ctime;
+        uint64_t dev;
+        uint64_t ino;
+        std::unique_ptr<Node> dir;
+    };
+
+    Ancestor self;
+    std::string path;
+    std::vector<Record> records;
+
+    //
+
+    void replay(const callback_t& callback) const
+    {
+        for (const auto& record : records)
+        {
+            if (record.dir) {
+                record.dir->replay(callback);
+            }
+            else {
+                callback(Entry{ record.path, record.size, record.mtime, record.ctime, record.dev, record.ino });
+            }
+        }
+    }
+};
+
+// a directory being summed; 'pending' counts its subdirectories still
+// being summed, and one for its own scan
+
+struct utils::DirWalker::FoldNode {
+    Ancestor self;
+    std::string path;
+    std::string name;
+    FoldNode* parent;
+    std::size_t slot;                   // of its line in the parent
+
+    std::vector<std::string> lines;
+    std::vector<std::unique_ptr<FoldNode>> children;
+    std::atomic<std::size_t> pending;
+    std::string sum;
+};
+
+bool utils::DirWalker::Ancestor::isLoop(uint64_t otherDev, uint64_t otherIno) const
+{
+    for (const Ancestor* a = this; a; a = a->parent)
+    {
+        if (a->dev == otherDev
+            && a->ino == otherIno)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// ------------------------------------------------------------
+
+utils::DirWalker::DirWalker(const std::vector<std::string>& exclude,
+                            unsigned int threads)
+    : m_threads(threads)
+{
+    for (const auto& pattern : exclude)
+    {
+        if (hasGlob(pattern)) {
+            m_globExcludes.push_back(pattern);
+        }
+        else {
+            m_exactExcludes.insert(pattern);
+        }
+    }
+}
+
+void utils::DirWalker::walk(const std::string& root, const callback_t& callback) const
+{
+    if (isExcluded(root)) {
+        return;
+    }
+
+    struct statx stx;
+
+    if (statx(AT_FDCWD, root.c_str(), 0, StatxMask, &stx) != 0)
+    {
+        return;
+    }
+
+    if (S_ISREG(stx.stx_mode))
+    {
+        callback(makeEntry(root, stx));
+    }
+    else if (S_ISDIR(stx.stx_mode))
+    {
+        const Ancestor self{ device(stx), stx.stx_ino, nullptr };
+
+        if (m_threads > 1) {
+            walkParallel(root, self, callback);
+            return;
+        }
+
+        const int dirFd = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+        if (dirFd < 0) {
+            return;
+        }
+
+        std::string path = root;
+
+        walkDir(dirFd, path, self, callback);
+        close(dirFd);
+    }
+}
+
+bool utils::DirWalker::isExcluded(const std::string& path) const
+{
+    if (m_exactExcludes.count(path) > 0) {
+        return true;
+    }
+
+    for (const auto& pattern : m_globExcludes)
+    {
+        if (fnmatch(pattern.c_str(), path.c_str(), 0) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void utils::DirWalker::walkDir(int dirFd,
+                               std::string& path,
+                               const Ancestor& ancestor,
+                               const callback_t& callback) const
+{
+    const std::size_t pathLength = path.size();
+
+    for (const auto& name : readNames(dirFd))
+    {
+        setName(path, pathLength, name);
+
+        if (isExcluded(path)) {
+            continue;
+        }
+
+        //
+
+        struct statx stx;
+
+        if (statx(dirFd, name.c_str(), 0, StatxMask, &stx) != 0) {
+            continue;       // dangling link, or vanished
+        }
+
+        if (S_ISREG(stx.stx_mode))
+        {
+            callback(makeEntry(path, stx));
+        }
+        else if (S_ISDIR(stx.stx_mode)
+                 && !ancestor.isLoop(device(stx), stx.stx_ino))
+        {
+            const int childFd = openat(dirFd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+            if (childFd < 0) {
+                continue;
+            }
+
+            const Ancestor self{ device(stx), stx.stx_ino, &ancestor };
+
+            walkDir(childFd, path, self, callback);
+            close(childFd);
+        }
+    }
+
+    path.resize(pathLength);
+}
+
+void utils::DirWalker::walkParallel(const std::string& root,
+                                    const Ancestor& ancestor,
+                                    const callback_t& callback) const
+{
+    // every directory becomes a task filling its own Node; subdirectories
+    // are opened by path, so no descriptors are held by queued tasks
+
+    TaskPool pool(m_threads);
+    std::function<void(Node&)> scan;
+
+    scan = [this, &pool, &scan] (Node& node)
+        {
+            const int dirFd = open(node.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+            if (dirFd < 0) {
+                return;
+            }
+
+            std::string path = node.path;
+
+            for (const auto& name : readNames(dirFd))
+            {
+                setName(path, node.path.size(), name);
+
+                if (isExcluded(path)) {
+                    continue;
+                }
+
+                //
+
+                struct statx stx;
+
+                if (statx(dirFd, name.c_str(), 0, StatxMask, &stx) != 0) {
+                    continue;
+                }
+
+                if (S_ISREG(stx.stx_mode))
+                {
+                    const Entry e = makeEntry(path, stx);
+
+                    node.records.push_back(Node::Record{ path, e.size, e.mtime, e.ctime, e.dev, e.ino, nullptr });
+                }
+                else if (S_ISDIR(stx.stx_mode)
+                         && !node.self.isLoop(device(stx), stx.stx_ino))
+                {
+                    auto child = std::make_unique<Node>();
+                    Node* const childPtr = child.get();
+
+                    child->self = Ancestor{ device(stx), stx.stx_ino, &node.self };
+                    child->path = path;
+
+                    node.records.push_back(Node::Record{ std::string(), 0, 0, 0, 0, 0, std::move(child) });
+
+                    pool.spawn([&scan, childPtr] () { scan(*childPtr); });
+                }
+            }
+
+            close(dirFd);
+        };
+
+    //
+
+    Node top;
+
+    top.self = ancestor;
+    top.path = root;
+
+    pool.spawn([&scan, &top] () { scan(top); });
+    pool.run();
+
+    top.replay(callback);
+}
+
+std::string utils::DirWalker::fold(const std::string& root, const Fold& fold) const
+{
+    if (isExcluded(root)) {
+        return std::string();
+    }
+
+    struct statx stx;
+
+    if (statx(AT_FDCWD, root.c_str(), 0, StatxMask, &stx) != 0) {
+        return std::string();
+    }
+
+    if (S_ISREG(stx.stx_mode)) {
+        return fold.digest(fold.fileLine(makeEntry(root, stx), root));
+    }
+    else if (!S_ISDIR(stx.stx_mode)) {
+        return std::string();
+    }
+
+    //
+
+    TaskPool pool(m_threads);
+
+    // the last one to finish with a directory sums it up, and then maybe
+    // its parent; the memory of the subtree is released on the way
+
+    std::function<void(FoldNode&)> finish;
+
+    finish = [&fold, &finish] (FoldNode& node)
+        {
+            if (--node.pending > 0) {
+                return;
+            }
+
+            std::string text;
+
+            for (const auto& line : node.lines) {
+                text += line;
+            }
+
+            node.sum = (text.empty()
+                        ? std::string()
+                        : fold.digest(text));
+
+            node.lines = std::vector<std::string>();
+            node.children.clear();
+
+            if (node.parent)
+            {
+                if (!node.sum.empty()) {
+                    node.parent->lines[node.slot] = fold.dirLine(node.name, node.sum);
+                }
+
+                finish(*node.parent);
+            }
+        };
+
+    std::function<void(FoldNode&)> scan;
+
+    scan = [this, &fold, &pool, &finish, &scan] (FoldNode& node)
+        {
+            const int dirFd = open(node.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+            if (dirFd >= 0)
+            {
+                std::string path = node.path;
+
+                for (const auto& name : readNames(dirFd))
+                {
+                    setName(path, node.path.size(), name);
+
+                    if (isExcluded(path)) {
+                        continue;
+                    }
+
+                    //
+
+                    struct statx stx;
+
+                    if (statx(dirFd, name.c_str(), 0, StatxMask, &stx) != 0) {
+                        continue;
+                    }
+
+                    if (S_ISREG(stx.stx_mode))
+                    {
+                        node.lines.push_back(fold.fileLine(makeEntry(path, stx), name));
+                    }
+                    else if (S_ISDIR(stx.stx_mode)
+                             && !node.self.isLoop(device(stx), stx.stx_ino))
+                    {
+                        auto child = std::make_unique<FoldNode>();
+
+                        child->self = Ancestor{ device(stx), stx.stx_ino, &node.self };
+                        child->path = path;
+                        child->name = name;
+                        child->parent = &node;
+                        child->slot = node.lines.size();
+
+                        node.lines.emplace_back();
+                        node.children.push_back(std::move(child));
+                    }
+                }
+
+                close(dirFd);
+            }
+
+            // the lines are complete before any child can write to its own
+
+            node.pending = node.children.size() + 1;
+
+            for (const auto& child : node.children)
+            {
+                FoldNode* const childPtr = child.get();
+
+                pool.spawn([&scan, childPtr] () { scan(*childPtr); });
+            }
+
+            finish(node);
+        };
+
+    //
+
+    FoldNode top;
+
+    top.self = Ancestor{ device(stx), stx.stx_ino, nullptr };
+    top.path = root;
+    top.parent = nullptr;
+    top.slot = 0;
+
+    pool.spawn([&scan, &top] () { scan(top); });
+    pool.run();
+
+    return top.sum;
+}
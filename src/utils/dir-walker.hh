@@ -0,0 +1,98 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace utils
+{
+    // Lists the regular files under a directory like `find -L <root> -type f`
+    // would, but in a fixed order: entries of each directory are visited
+    // sorted by name, depth first. Symbolic links are followed; a link back
+    // to a directory being walked is skipped.
+    //
+    // With more than one thread, directories are read and stat'ed on a
+    // work-stealing pool and the results replayed in the same order, so the
+    // callback sees exactly the sequence a single thread would produce.
+    //
+    // fold() sums the tree up instead, one pool task per directory: the
+    // sum of a directory is 'digest' of the lines of its entries in walk
+    // order, 'fileLine' for a file and 'dirLine' for a subdirectory with
+    // its sum, and directories without files are left out. A directory is
+    // summed as soon as its subdirectories are, on whichever thread
+    // finishes last, so the sums do not depend on the number of threads or
+    // on scheduling, and only the directories in progress are held in
+    // memory.
+    //
+    // Excludes have the semantics of `-path <pattern> -prune`: a pattern is
+    // matched (fnmatch without FNM_PATHNAME) against the whole path, and a
+    // matching directory is never opened.
+
+    class DirWalker {
+    public:
+        struct Entry {
+            const std::string& path;
+            uint64_t size;
+            int64_t mtime;      // nanoseconds
+            int64_t ctime;
+            uint64_t dev;
+            uint64_t ino;
+        };
+
+        using callback_t = std::function<void(const Entry&)>;
+
+        struct Fold {
+            std::function<std::string(const Entry& entry, const std::string& name)> fileLine;
+            std::function<std::string(const std::string& name, const std::string& sum)> dirLine;
+            std::function<std::string(const std::string& lines)> digest;
+        };
+
+        //
+
+        DirWalker(const std::vector<std::string>& exclude,
+                  unsigned int threads = 1);
+
+        void walk(const std::string& root, const callback_t& callback) const;
+
+        // sum of 'root', empty if there are no files under it
+
+        std::string fold(const std::string& root, const Fold& fold) const;
+
+        bool isExcluded(const std::string& path) const;
+
+    private:
+        struct Ancestor {
+            uint64_t dev;
+            uint64_t ino;
+            const Ancestor* parent;
+
+            bool isLoop(uint64_t dev, uint64_t ino) const;
+        };
+
+        struct Node;
+        struct FoldNode;
+
+        std::unordered_set<std::string> m_exactExcludes;
+        std::vector<std::string> m_globExcludes;
+        unsigned int m_threads;
+
+        //
+
+        void walkDir(int dirFd,
+                     std::string& path,
+                     const Ancestor& ancestor,
+                     const callback_t& callback) const;
+
+        void walkParallel(const std::string& root,
+                          const Ancestor& ancestor,
+                          const callback_t& callback) const;
+    };
+}
@@ -8,6 +8,7 @@
 
 #include "../config.hh"
 
+#include <csignal>
 #include <cstring>
 #include <sstream>
 #include <stdexcept>
@@ -28,8 +29,10 @@ namespace
         if (oldfd < 0 || newfd < 0)
             throw logic_error("copy_fd given invalid fds");
 
-        if (oldfd == newfd)
+        if (oldfd == newfd) {
+            fcntl(newfd, F_SETFD, 0);       // keep it over exec
             return;
+        }
 
         if (dup2(oldfd, newfd) < 0)
         {
@@ -47,6 +50,9 @@ namespace
                                          utils::Exec::Flags flags,
                                          pid_t& pid)
     {
+        // all close-on-exec, so that children forked by other threads at the
+        // same time do not hold on to them
+
         int fds_read[2]  {-1, -1};
         int fds_write[2] {-1, -1};
 
@@ -54,8 +60,8 @@ namespace
 
         if (flags.flag(utils::Exec::Flag::DevNullRead))
         {
-            fds_read[0] = open("/dev/null", O_RDWR);
-            fds_read[1] = open("/dev/null", O_RDWR);
+            fds_read[0] = open("/dev/null", O_RDWR | O_CLOEXEC);
+            fds_read[1] = open("/dev/null", O_RDWR | O_CLOEXEC);
 
             if (fds_read[0] < 0
                 || fds_read[1] < 0)
@@ -64,7 +70,7 @@ namespace
             }
         }
         else {
-            if (pipe(fds_read) != 0)
+            if (pipe2(fds_read, O_CLOEXEC) != 0)
             {
                 throw runtime_error("pipe: "s + strerror(errno));
             }
@@ -74,8 +80,8 @@ namespace
 
         if (flags.flag(utils::Exec::Flag::DevNullWrite))
         {
-            fds_write[0] = open("/dev/null", O_RDWR);
-            fds_write[1] = open("/dev/null", O_RDWR);
+            fds_write[0] = open("/dev/null", O_RDWR | O_CLOEXEC);
+            fds_write[1] = open("/dev/null", O_RDWR | O_CLOEXEC);
 
             if (fds_write[0] < 0
                 || fds_write[1] < 0)
@@ -83,7 +89,7 @@ namespace
                 throw runtime_error("failed to open /dev/null");
             }
         }
-        else if (pipe(fds_write) != 0)
+        else if (pipe2(fds_write, O_CLOEXEC) != 0)
         {
             close(fds_read[0]);
             close(fds_read[1]);
@@ -100,6 +106,8 @@ namespace
         }
         else if (pid == 0) // child
         {
+            signal(SIGPIPE, SIG_DFL);       // ignored by a resident swd
+
             close(fds_read[0]);
             close(fds_write[1]);
 
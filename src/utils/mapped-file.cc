@@ -0,0 +1,101 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "mapped-file.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    enum { ReadBlockSize = 1024 * 1024 };
+}
+
+// ------------------------------------------------------------
+
+utils::MappedFile::MappedFile(int fd, uint64_t size)
+    : m_size(size)
+{
+    if (size == 0
+        || size > SIZE_MAX)
+    {
+        return;
+    }
+
+    void* p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (p == MAP_FAILED) {
+        return;
+    }
+
+    madvise(p, size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<uint8_t*>(p);
+}
+
+utils::MappedFile::~MappedFile()
+{
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+}
+
+// ------------------------------------------------------------
+
+utils::AlignedBuffer::AlignedBuffer(std::size_t size)
+{
+    void* p = nullptr;
+
+    if (posix_memalign(&p, Alignment, size) != 0) {
+        throw std::bad_alloc();
+    }
+
+    m_data = static_cast<uint8_t*>(p);
+}
+
+utils::AlignedBuffer::~AlignedBuffer()
+{
+    free(m_data);
+}
+
+// ------------------------------------------------------------
+
+uint64_t utils::readAll(int fd,
+                        const std::function<void(const uint8_t*, std::size_t)>& consume)
+{
+    const AlignedBuffer buffer(ReadBlockSize);
+    uint64_t total = 0;
+
+    for (;;)
+    {
+        const ssize_t got = read(fd, buffer.data(), ReadBlockSize);
+
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw std::runtime_error(std::string("read: ") + strerror(errno));
+        }
+        else if (got == 0) {
+            break;
+        }
+
+        consume(buffer.data(), got);
+        total += got;
+    }
+
+    return total;
+}
@@ -0,0 +1,66 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace utils
+{
+    // Read-only shared mapping of a whole file, advised for sequential
+    // access. isMapped() is false when the file could not be mapped (pipes,
+    // procfs and other special files); readAll() is the fallback for those.
+
+    class MappedFile {
+    public:
+        MappedFile(int fd, uint64_t size);
+        ~MappedFile();
+
+        bool isMapped() const { return m_data != nullptr; }
+
+        const uint8_t* data() const { return m_data; }
+        uint64_t size() const { return m_size; }
+
+    private:
+        uint8_t* m_data = nullptr;
+        uint64_t m_size;
+
+        //
+
+        MappedFile(const MappedFile&) = delete;
+    };
+
+    // -----
+
+    // Heap block aligned for O_DIRECT reads.
+
+    class AlignedBuffer {
+    public:
+        enum { Alignment = 4096 };
+
+        AlignedBuffer(std::size_t size);
+        ~AlignedBuffer();
+
+        uint8_t* data() const { return m_data; }
+
+    private:
+        uint8_t* m_data;
+
+        //
+
+        AlignedBuffer(const AlignedBuffer&) = delete;
+    };
+
+    // -----
+
+    // Reads fd to the end in large page-aligned blocks, passing each block
+    // to 'consume'. Returns the number of bytes read.
+
+    uint64_t readAll(int fd,
+                     const std::function<void(const uint8_t*, std::size_t)>& consume);
+}
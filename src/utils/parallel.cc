@@ -0,0 +1,213 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "parallel.hh"
+
+#include <chrono>
+#include <thread>
+
+//
+
+namespace
+{
+    // the pool and queue index of the worker running on this thread
+
+    thread_local const utils::TaskPool* t_pool = nullptr;
+    thread_local unsigned int t_queue = 0;
+}
+
+// ------------------------------------------------------------
+
+void utils::parallelFor(std::size_t count,
+                        unsigned int threads,
+                        const std::function<void(std::size_t)>& func)
+{
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&] ()
+        {
+            for (std::size_t index;
+                 !failed
+                     && (index = next++) < count;
+                 )
+            {
+                try {
+                    func(index);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+
+                    failed = true;
+                }
+            }
+        };
+
+    //
+
+    if (threads > count) {
+        threads = count;
+    }
+
+    std::vector<std::thread> pool;
+
+    for (unsigned int i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+unsigned int utils::hardwareThreads()
+{
+    const unsigned int n = std::thread::hardware_concurrency();
+
+    return (n > 0 ? n : 1);
+}
+
+// ------------------------------------------------------------
+
+utils::TaskPool::TaskPool(unsigned int threads)
+    : m_pending(0),
+      m_queued(0),
+      m_failed(false)
+{
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    for (unsigned int i = 0; i < threads; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+utils::TaskPool::~TaskPool() = default;
+
+void utils::TaskPool::spawn(task_t&& task)
+{
+    const unsigned int self = (t_pool == this ? t_queue : 0);
+    Queue& queue = *m_queues[self];
+
+    ++m_pending;
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_front(std::move(task));
+    }
+
+    ++m_queued;
+    m_idle.notify_one();
+}
+
+void utils::TaskPool::run()
+{
+    std::vector<std::thread> pool;
+
+    for (unsigned int i = 1; i < m_queues.size(); ++i) {
+        pool.emplace_back([this, i] () { work(i); });
+    }
+
+    work(0);
+
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+bool utils::TaskPool::take(unsigned int self, task_t& task)
+{
+    const unsigned int count = m_queues.size();
+
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        Queue& queue = *m_queues[(self + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        if (queue.tasks.empty()) {
+            continue;
+        }
+
+        if (i == 0) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        else {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+
+        --m_queued;
+        return true;
+    }
+
+    return false;
+}
+
+void utils::TaskPool::work(unsigned int self)
+{
+    t_pool = this;
+    t_queue = self;
+
+    for (;;)
+    {
+        task_t task;
+
+        if (take(self, task))
+        {
+            if (!m_failed)
+            {
+                try {
+                    task();
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(m_errorMutex);
+
+                    if (!m_error) {
+                        m_error = std::current_exception();
+                    }
+
+                    m_failed = true;
+                }
+            }
+
+            if (--m_pending == 0)
+            {
+                std::lock_guard<std::mutex> lock(m_idleMutex);
+                m_idle.notify_all();
+            }
+        }
+        else if (m_pending == 0) {
+            break;
+        }
+        else {
+            std::unique_lock<std::mutex> lock(m_idleMutex);
+
+            m_idle.wait_for(lock,
+                            std::chrono::milliseconds(1),
+                            [this] () { return m_pending == 0 || m_queued > 0; });
+        }
+    }
+
+    t_pool = nullptr;
+}
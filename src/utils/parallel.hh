@@ -0,0 +1,75 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace utils
+{
+    // Calls func(0) ... func(count - 1) from up to 'threads' threads (the
+    // calling thread included). The first exception thrown by func is
+    // rethrown after all threads have stopped.
+
+    void parallelFor(std::size_t count,
+                     unsigned int threads,
+                     const std::function<void(std::size_t)>& func);
+
+    unsigned int hardwareThreads();
+
+    // -----
+
+    // Work-stealing pool for work that is discovered while it is being done
+    // (e.g. walking a directory tree). Tasks spawned by a task go to the
+    // front of its own thread's queue; idle threads steal from the back of
+    // the others' queues. run() returns once every task has finished, and
+    // rethrows the first exception thrown by a task.
+
+    class TaskPool {
+    public:
+        using task_t = std::function<void()>;
+
+        //
+
+        TaskPool(unsigned int threads);
+        ~TaskPool();
+
+        void spawn(task_t&& task);
+        void run();
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<task_t> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::atomic<std::size_t> m_pending;
+        std::atomic<std::size_t> m_queued;
+        std::atomic<bool> m_failed;
+
+        std::mutex m_idleMutex;
+        std::condition_variable m_idle;
+
+        std::exception_ptr m_error;
+        std::mutex m_errorMutex;
+
+        //
+
+        bool take(unsigned int self, task_t& task);
+        void work(unsigned int self);
+
+        TaskPool(const TaskPool&) = delete;
+    };
+}
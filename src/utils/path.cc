@@ -9,8 +9,10 @@
 #include <cstring>
 #include <stdexcept>
 
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -36,6 +38,20 @@ struct dirent *utils::OpenDir::readdir()
 
 // ------------------------------------------------------------
 
+utils::OpenFile::OpenFile(const string& path, int flags)
+    : m_fd(open(path.c_str(), flags | O_CLOEXEC))
+{
+}
+
+utils::OpenFile::~OpenFile()
+{
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+// ------------------------------------------------------------
+
 void utils::safeMkdir(const std::string& path)
 {
     if (mkdir(path.c_str(), 0777) != 0)
@@ -60,3 +76,15 @@ void utils::safeMkdir(const std::string& path)
         }
     }
 }
+
+void utils::safeMkdirs(const std::string& path)
+{
+    for (string::size_type slash = path.find('/', 1);
+         slash != string::npos;
+         slash = path.find('/', slash + 1))
+    {
+        safeMkdir(path.substr(0, slash));
+    }
+
+    safeMkdir(path);
+}
@@ -25,5 +25,24 @@ namespace utils
 
     // -----
 
+    class OpenFile {
+    public:
+        OpenFile(const std::string& path, int flags);
+        ~OpenFile();
+
+        bool isOpen() const { return m_fd >= 0; }
+        int fd() const { return m_fd; }
+
+    private:
+        int m_fd;
+
+        //
+
+        OpenFile(const OpenFile&) = delete;
+    };
+
+    // -----
+
     void safeMkdir(const std::string& path);
+    void safeMkdirs(const std::string& path);       // and missing parents
 }
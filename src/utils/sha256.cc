@@ -0,0 +1,322 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "sha256.hh"
+
+#include "string.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define SWD_SHA256_X86 1
+#  include <cpuid.h>
+#  include <immintrin.h>
+#endif
+
+//
+
+namespace
+{
+    const uint32_t InitialState[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    inline uint32_t rotr(uint32_t x, unsigned int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    inline uint32_t loadBE32(const uint8_t* p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    void compressPortable(uint32_t state[8], const uint8_t* data, std::size_t blocks)
+    {
+        uint32_t w[64];
+
+        for (; blocks > 0; --blocks, data += utils::Sha256::BlockSize)
+        {
+            for (int i = 0; i < 16; ++i) {
+                w[i] = loadBE32(data + 4*i);
+            }
+
+            for (int i = 16; i < 64; ++i)
+            {
+                const uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+                const uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+
+                w[i] = w[i-16] + s0 + w[i-7] + s1;
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+            for (int i = 0; i < 64; ++i)
+            {
+                const uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+                const uint32_t ch = (e & f) ^ (~e & g);
+                const uint32_t t1 = h + S1 + ch + K[i] + w[i];
+                const uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+                const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+                const uint32_t t2 = S0 + maj;
+
+                h = g; g = f; f = e;
+                e = d + t1;
+                d = c; c = b; b = a;
+                a = t1 + t2;
+            }
+
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+    }
+
+#ifdef SWD_SHA256_X86
+
+    // Block function using the SHA-NI instructions. Two rounds per
+    // sha256rnds2, message schedule with sha256msg1/sha256msg2.
+
+    __attribute__((target("sha,sse4.1")))
+    void compressShaNi(uint32_t state[8], const uint8_t* data, std::size_t blocks)
+    {
+        const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+        __m128i tmp    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+        __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+
+        tmp    = _mm_shuffle_epi32(tmp, 0xB1);          // CDAB
+        state1 = _mm_shuffle_epi32(state1, 0x1B);       // EFGH
+        __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+        state1 = _mm_blend_epi16(state1, tmp, 0xF0);    // CDGH
+
+        for (; blocks > 0; --blocks, data += utils::Sha256::BlockSize)
+        {
+            const __m128i abefSave = state0;
+            const __m128i cdghSave = state1;
+
+            __m128i msg;
+            __m128i msg0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data +  0)), MASK);
+            __m128i msg1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16)), MASK);
+            __m128i msg2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32)), MASK);
+            __m128i msg3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48)), MASK);
+
+            // rounds 0-3
+            msg = _mm_add_epi32(msg0, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[0])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            // rounds 4-7
+            msg = _mm_add_epi32(msg1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            msg0 = _mm_sha256msg1_epu32(msg0, msg1);
+
+            // rounds 8-11
+            msg = _mm_add_epi32(msg2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[8])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            msg1 = _mm_sha256msg1_epu32(msg1, msg2);
+
+            // rounds 12-51: the schedule rotates through msg0..msg3
+
+            __m128i* const msgs[4] = { &msg0, &msg1, &msg2, &msg3 };
+
+            for (int r = 12; r < 52; r += 4)
+            {
+                __m128i& cur  = *msgs[(r / 4) % 4];
+                __m128i& prev = *msgs[(r / 4 + 3) % 4];
+                __m128i& next = *msgs[(r / 4 + 1) % 4];
+
+                msg = _mm_add_epi32(cur, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[r])));
+                state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+                tmp = _mm_alignr_epi8(cur, prev, 4);
+                next = _mm_add_epi32(next, tmp);
+                next = _mm_sha256msg2_epu32(next, cur);
+                msg = _mm_shuffle_epi32(msg, 0x0E);
+                state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+                prev = _mm_sha256msg1_epu32(prev, cur);
+            }
+
+            // rounds 52-55
+            msg = _mm_add_epi32(msg1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[52])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            tmp = _mm_alignr_epi8(msg1, msg0, 4);
+            msg2 = _mm_add_epi32(msg2, tmp);
+            msg2 = _mm_sha256msg2_epu32(msg2, msg1);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            // rounds 56-59
+            msg = _mm_add_epi32(msg2, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[56])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            tmp = _mm_alignr_epi8(msg2, msg1, 4);
+            msg3 = _mm_add_epi32(msg3, tmp);
+            msg3 = _mm_sha256msg2_epu32(msg3, msg2);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            // rounds 60-63
+            msg = _mm_add_epi32(msg3, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&K[60])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+
+            state0 = _mm_add_epi32(state0, abefSave);
+            state1 = _mm_add_epi32(state1, cdghSave);
+        }
+
+        tmp    = _mm_shuffle_epi32(state0, 0x1B);       // FEBA
+        state1 = _mm_shuffle_epi32(state1, 0xB1);       // DCHG
+        state0 = _mm_blend_epi16(tmp, state1, 0xF0);    // DCBA
+        state1 = _mm_alignr_epi8(state1, tmp, 8);       // ABEF
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+    }
+
+    bool cpuHasShaNi()
+    {
+        unsigned int eax, ebx, ecx, edx;
+
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+            || !(ecx & bit_SSSE3)
+            || !(ecx & bit_SSE4_1))
+        {
+            return false;
+        }
+
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+
+        return ebx & bit_SHA;
+    }
+
+#endif
+
+    //
+
+    using compress_t = void (*)(uint32_t[8], const uint8_t*, std::size_t);
+
+    compress_t selectCompress()
+    {
+#ifdef SWD_SHA256_X86
+        if (cpuHasShaNi()) {
+            return &compressShaNi;
+        }
+#endif
+        return &compressPortable;
+    }
+
+    const compress_t s_compress = selectCompress();
+}
+
+// ------------------------------------------------------------
+
+utils::Sha256::Sha256()
+{
+    memcpy(m_state, InitialState, sizeof(m_state));
+}
+
+void utils::Sha256::update(const void* data, std::size_t size)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+
+    m_length += size;
+
+    if (m_buffered > 0)
+    {
+        const std::size_t take = std::min<std::size_t>(size, BlockSize - m_buffered);
+
+        memcpy(m_buffer + m_buffered, p, take);
+        m_buffered += take;
+        p += take;
+        size -= take;
+
+        if (m_buffered < BlockSize) {
+            return;
+        }
+
+        s_compress(m_state, m_buffer, 1);
+        m_buffered = 0;
+    }
+
+    if (size >= BlockSize)
+    {
+        const std::size_t blocks = size / BlockSize;
+
+        s_compress(m_state, p, blocks);
+        p += blocks * BlockSize;
+        size -= blocks * BlockSize;
+    }
+
+    if (size > 0)
+    {
+        memcpy(m_buffer, p, size);
+        m_buffered = size;
+    }
+}
+
+void utils::Sha256::final(uint8_t digest[DigestSize])
+{
+    const uint64_t bitLength = m_length * 8;
+
+    m_buffer[m_buffered++] = 0x80;
+
+    if (m_buffered > BlockSize - 8)
+    {
+        memset(m_buffer + m_buffered, 0, BlockSize - m_buffered);
+        s_compress(m_state, m_buffer, 1);
+        m_buffered = 0;
+    }
+
+    memset(m_buffer + m_buffered, 0, BlockSize - 8 - m_buffered);
+
+    for (int i = 0; i < 8; ++i) {
+        m_buffer[BlockSize - 1 - i] = uint8_t(bitLength >> (8 * i));
+    }
+
+    s_compress(m_state, m_buffer, 1);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        digest[4*i]     = uint8_t(m_state[i] >> 24);
+        digest[4*i + 1] = uint8_t(m_state[i] >> 16);
+        digest[4*i + 2] = uint8_t(m_state[i] >> 8);
+        digest[4*i + 3] = uint8_t(m_state[i]);
+    }
+}
+
+std::string utils::Sha256::hexdigest()
+{
+    uint8_t digest[DigestSize];
+
+    final(digest);
+
+    return toHex(digest, DigestSize);
+}
+
+bool utils::Sha256::accelerated()
+{
+    return s_compress != &compressPortable;
+}
@@ -0,0 +1,44 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace utils
+{
+    // Incremental SHA-256 (FIPS 180-4). Uses the x86 SHA extensions when the
+    // CPU has them, otherwise a portable implementation.
+
+    class Sha256 {
+    public:
+        enum {
+            BlockSize  = 64,
+            DigestSize = 32,
+        };
+
+        //
+
+        Sha256();
+
+        void update(const void* data, std::size_t size);
+        void final(uint8_t digest[DigestSize]);
+
+        std::string hexdigest();
+
+        //
+
+        static bool accelerated();
+
+    private:
+        uint32_t m_state[8];
+        uint64_t m_length = 0;
+        uint8_t m_buffer[BlockSize];
+        std::size_t m_buffered = 0;
+    };
+}
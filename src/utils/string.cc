@@ -9,6 +9,11 @@
 #include <algorithm>
 #include <iterator>
 
+#if defined(__SSE2__)
+#  define SWD_HEX_SSE2 1
+#  include <emmintrin.h>
+#endif
+
 std::string utils::tolower(const std::string& orig)
 {
     std::string s;
@@ -34,3 +39,80 @@ void utils::tolower(std::string& s)
                        return std::tolower(c);
                    });
 }
+
+std::string utils::toHex(const uint8_t* data, std::size_t size)
+{
+    std::string hex(size * 2, '\0');
+
+    toHex(data, size, &hex[0]);
+
+    return hex;
+}
+
+void utils::toHex(const uint8_t* data, std::size_t size, char* out)
+{
+    static const char Digits[] = "0123456789abcdef";
+
+    std::size_t i = 0;
+
+#ifdef SWD_HEX_SSE2
+    // 16 bytes at a time: split into nibbles, interleave high and low, and
+    // map 0-9 to '0'-'9' and 10-15 to 'a'-'f'
+
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+
+    const auto digits = [&] (__m128i nibbles)
+        {
+            const __m128i above9 = _mm_cmpgt_epi8(nibbles, nine);
+            return _mm_add_epi8(_mm_add_epi8(nibbles, zero),
+                                _mm_and_si128(above9, letters));
+        };
+
+    for (; i + 16 <= size; i += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+        const __m128i low = _mm_and_si128(bytes, mask);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2*i),      digits(_mm_unpacklo_epi8(high, low)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2*i + 16), digits(_mm_unpackhi_epi8(high, low)));
+    }
+#endif
+
+    for (; i < size; ++i)
+    {
+        out[2*i]     = Digits[data[i] >> 4];
+        out[2*i + 1] = Digits[data[i] & 0xf];
+    }
+}
+
+bool utils::fromHex(const char* hex, std::size_t length, uint8_t* out, std::size_t size)
+{
+    if (length != size * 2) {
+        return false;
+    }
+
+    const auto nibble = [] (char c) -> int
+        {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            return -1;
+        };
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const int high = nibble(hex[2*i]);
+        const int low = nibble(hex[2*i + 1]);
+
+        if (high < 0 || low < 0) {
+            return false;
+        }
+
+        out[i] = uint8_t((high << 4) | low);
+    }
+
+    return true;
+}
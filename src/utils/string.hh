@@ -6,10 +6,19 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 namespace utils
 {
     std::string tolower(const std::string& s);
     void tolower(std::string& s);
+
+    std::string toHex(const uint8_t* data, std::size_t size);
+    void toHex(const uint8_t* data, std::size_t size, char* out);      // writes 2*size characters
+
+    // false if 'hex' is not 2*size hex digits
+
+    bool fromHex(const char* hex, std::size_t length, uint8_t* out, std::size_t size);
 }
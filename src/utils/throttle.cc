@@ -0,0 +1,39 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "throttle.hh"
+
+#include <thread>
+
+utils::Throttle::Throttle(uint64_t bytesPerSecond)
+    : m_bytesPerSecond(bytesPerSecond),
+      m_next(clock::now())
+{
+}
+
+void utils::Throttle::consume(uint64_t bytes)
+{
+    if (m_bytesPerSecond == 0) {
+        return;
+    }
+
+    // every block gets a time slot after the previous one; an idle period
+    // is not saved up for later bursts
+
+    const auto cost = std::chrono::nanoseconds(bytes * 1000000000 / m_bytesPerSecond);
+    clock::time_point start;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        const auto now = clock::now();
+
+        start = (m_next > now ? m_next : now);
+        m_next = start + cost;
+    }
+
+    std::this_thread::sleep_until(start);
+}
@@ -0,0 +1,33 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace utils
+{
+    // Paces consumers of a shared bandwidth: consume(n) sleeps until the n
+    // bytes fit into 'bytesPerSecond', counted over every thread using the
+    // same Throttle.
+
+    class Throttle {
+    public:
+        Throttle(uint64_t bytesPerSecond);
+
+        void consume(uint64_t bytes);
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        const uint64_t m_bytesPerSecond;
+
+        std::mutex m_mutex;
+        clock::time_point m_next;
+    };
+}
@@ -0,0 +1,210 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "uring.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//
+
+namespace
+{
+    inline unsigned int loadAcquire(const unsigned int* p)
+    {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    inline void storeRelease(unsigned int* p, unsigned int v)
+    {
+        __atomic_store_n(p, v, __ATOMIC_RELEASE);
+    }
+
+    inline unsigned int* at(void* base, uint32_t offset)
+    {
+        return reinterpret_cast<unsigned int*>(static_cast<char*>(base) + offset);
+    }
+}
+
+// ------------------------------------------------------------
+
+utils::IoUring::IoUring(unsigned int entries)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+
+    m_fd = syscall(__NR_io_uring_setup, entries, &params);
+
+    if (m_fd < 0) {
+        m_fd = -1;
+        return;
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (m_cqRingSize > m_sqRingSize) {
+            m_sqRingSize = m_cqRingSize;
+        }
+
+        m_cqRingSize = 0;
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_fd, IORING_OFF_SQ_RING);
+
+    m_cqRing = ((m_sqRing != MAP_FAILED && m_cqRingSize == 0)
+                ? m_sqRing
+                : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       m_fd, IORING_OFF_CQ_RING));
+
+    m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  m_fd, IORING_OFF_SQES);
+
+    if (m_sqRing == MAP_FAILED
+        || m_cqRing == MAP_FAILED
+        || m_sqes == MAP_FAILED)
+    {
+        if (m_sqRing != MAP_FAILED) munmap(m_sqRing, m_sqRingSize);
+        if (m_cqRing != MAP_FAILED && m_cqRingSize > 0) munmap(m_cqRing, m_cqRingSize);
+        if (m_sqes != MAP_FAILED) munmap(m_sqes, m_sqesSize);
+
+        m_sqRing = m_cqRing = m_sqes = nullptr;
+
+        close(m_fd);
+        m_fd = -1;
+        return;
+    }
+
+    m_sqHead    = at(m_sqRing, params.sq_off.head);
+    m_sqTail    = at(m_sqRing, params.sq_off.tail);
+    m_sqMask    = *at(m_sqRing, params.sq_off.ring_mask);
+    m_sqEntries = *at(m_sqRing, params.sq_off.ring_entries);
+    m_sqArray   = at(m_sqRing, params.sq_off.array);
+
+    m_cqHead = at(m_cqRing, params.cq_off.head);
+    m_cqTail = at(m_cqRing, params.cq_off.tail);
+    m_cqMask = *at(m_cqRing, params.cq_off.ring_mask);
+    m_cqes   = static_cast<char*>(m_cqRing) + params.cq_off.cqes;
+}
+
+utils::IoUring::~IoUring()
+{
+    if (m_fd < 0) {
+        return;
+    }
+
+    munmap(m_sqes, m_sqesSize);
+
+    if (m_cqRingSize > 0) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+
+    munmap(m_sqRing, m_sqRingSize);
+    close(m_fd);
+}
+
+bool utils::IoUring::openat(int dirFd, const char* path, int flags, uint64_t userData)
+{
+    auto* sqe = static_cast<struct io_uring_sqe*>(nextSqe());
+
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = dirFd;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->open_flags = flags;
+    sqe->user_data = userData;
+
+    commitSqe();
+    return true;
+}
+
+bool utils::IoUring::read(int fd, void* buffer, unsigned int size, uint64_t offset, uint64_t userData)
+{
+    auto* sqe = static_cast<struct io_uring_sqe*>(nextSqe());
+
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = userData;
+
+    commitSqe();
+    return true;
+}
+
+utils::IoUring::Completion utils::IoUring::wait()
+{
+    for (;;)
+    {
+        const unsigned int head = *m_cqHead;
+
+        if (head != loadAcquire(m_cqTail))
+        {
+            const auto& cqe = static_cast<const struct io_uring_cqe*>(m_cqes)[head & m_cqMask];
+            const Completion completion{ cqe.user_data, cqe.res };
+
+            storeRelease(m_cqHead, head + 1);
+
+            return completion;
+        }
+
+        const int ret = syscall(__NR_io_uring_enter, m_fd, m_queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+        if (ret < 0)
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw std::runtime_error(std::string("io_uring_enter: ") + strerror(errno));
+        }
+
+        m_queued -= (unsigned(ret) < m_queued ? unsigned(ret) : m_queued);
+    }
+}
+
+void* utils::IoUring::nextSqe()
+{
+    const unsigned int tail = *m_sqTail;
+
+    if (tail - loadAcquire(m_sqHead) >= m_sqEntries) {
+        return nullptr;
+    }
+
+    const unsigned int index = tail & m_sqMask;
+    auto* sqe = &static_cast<struct io_uring_sqe*>(m_sqes)[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[index] = index;
+
+    return sqe;
+}
+
+void utils::IoUring::commitSqe()
+{
+    storeRelease(m_sqTail, *m_sqTail + 1);
+    ++m_queued;
+}
@@ -0,0 +1,71 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace utils
+{
+    // Minimal io_uring over the raw system calls. isOpen() is false when the
+    // kernel does not provide io_uring (or it is disabled), and callers are
+    // expected to fall back to plain system calls.
+
+    class IoUring {
+    public:
+        struct Completion {
+            uint64_t userData;
+            int result;         // as the system call would return, -errno on failure
+        };
+
+        //
+
+        IoUring(unsigned int entries);
+        ~IoUring();
+
+        bool isOpen() const { return m_fd >= 0; }
+
+        // queue requests; false if the submission queue is full
+
+        bool openat(int dirFd, const char* path, int flags, uint64_t userData);
+        bool read(int fd, void* buffer, unsigned int size, uint64_t offset, uint64_t userData);
+
+        // submits what was queued and waits for at least one completion
+
+        Completion wait();
+
+    private:
+        int m_fd = -1;
+
+        void* m_sqRing = nullptr;
+        void* m_cqRing = nullptr;
+        void* m_sqes = nullptr;
+        std::size_t m_sqRingSize = 0;
+        std::size_t m_cqRingSize = 0;
+        std::size_t m_sqesSize = 0;
+
+        unsigned int* m_sqHead = nullptr;
+        unsigned int* m_sqTail = nullptr;
+        unsigned int m_sqMask = 0;
+        unsigned int m_sqEntries = 0;
+        unsigned int* m_sqArray = nullptr;
+
+        unsigned int* m_cqHead = nullptr;
+        unsigned int* m_cqTail = nullptr;
+        unsigned int m_cqMask = 0;
+        void* m_cqes = nullptr;
+
+        unsigned int m_queued = 0;
+
+        //
+
+        void* nextSqe();
+        void commitSqe();
+
+        IoUring(const IoUring&) = delete;
+    };
+}
@@ -0,0 +1,433 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#include "xxh3.hh"
+
+#include "string.hh"
+
+#include <cstring>
+
+//
+
+namespace
+{
+    const uint32_t Prime32_1 = 0x9E3779B1U;
+    const uint32_t Prime32_2 = 0x85EBCA77U;
+    const uint32_t Prime32_3 = 0xC2B2AE3DU;
+
+    const uint64_t Prime64_1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t Prime64_3 = 0x165667B19E3779F9ULL;
+    const uint64_t Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t Prime64_5 = 0x27D4EB2F165667C5ULL;
+
+    const uint64_t PrimeMx1 = 0x165667919E3779F9ULL;
+    const uint64_t PrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+    enum {
+        StripeLen         = 64,
+        SecretSize        = 192,
+        SecretConsumeRate = 8,
+        StripesPerBlock   = (SecretSize - StripeLen) / SecretConsumeRate,
+        SecretLimit       = SecretSize - StripeLen,
+        LastAccStart      = 7,
+        MergeAccsStart    = 11,
+        MidSizeMax        = 240,
+        MidSizeStart      = 3,
+        MidSizeLast       = 17,
+        SecretSizeMin     = 136,
+    };
+
+    const uint8_t Secret[SecretSize] = {
+        0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+        0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+        0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+        0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+        0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+        0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+        0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+        0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+        0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+        0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+        0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+    };
+
+    struct u128 {
+        uint64_t low;
+        uint64_t high;
+    };
+
+    //
+
+    inline uint32_t readLE32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap32(v);
+#endif
+        return v;
+    }
+
+    inline uint64_t readLE64(const uint8_t* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = __builtin_bswap64(v);
+#endif
+        return v;
+    }
+
+    inline uint32_t rotl32(uint32_t x, unsigned int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    inline u128 mult64to128(uint64_t a, uint64_t b)
+    {
+        const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+        return { uint64_t(product), uint64_t(product >> 64) };
+    }
+
+    inline uint64_t mul128fold64(uint64_t a, uint64_t b)
+    {
+        const u128 product = mult64to128(a, b);
+        return product.low ^ product.high;
+    }
+
+    inline uint64_t xorshift64(uint64_t v, unsigned int shift)
+    {
+        return v ^ (v >> shift);
+    }
+
+    uint64_t xxh64Avalanche(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= Prime64_2;
+        h ^= h >> 29;
+        h *= Prime64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    uint64_t xxh3Avalanche(uint64_t h)
+    {
+        h = xorshift64(h, 37);
+        h *= PrimeMx1;
+        h = xorshift64(h, 32);
+        return h;
+    }
+
+    // short inputs
+
+    u128 len1to3(const uint8_t* input, std::size_t len)
+    {
+        const uint8_t c1 = input[0];
+        const uint8_t c2 = input[len >> 1];
+        const uint8_t c3 = input[len - 1];
+
+        const uint32_t combinedl = (uint32_t(c1) << 16) | (uint32_t(c2) << 24) | uint32_t(c3) | (uint32_t(len) << 8);
+        const uint32_t combinedh = rotl32(__builtin_bswap32(combinedl), 13);
+
+        const uint64_t bitflipl = readLE32(Secret) ^ readLE32(Secret + 4);
+        const uint64_t bitfliph = readLE32(Secret + 8) ^ readLE32(Secret + 12);
+
+        return { xxh64Avalanche(combinedl ^ bitflipl),
+                 xxh64Avalanche(combinedh ^ bitfliph) };
+    }
+
+    u128 len4to8(const uint8_t* input, std::size_t len)
+    {
+        const uint32_t inputLo = readLE32(input);
+        const uint32_t inputHi = readLE32(input + len - 4);
+        const uint64_t input64 = inputLo + (uint64_t(inputHi) << 32);
+        const uint64_t bitflip = readLE64(Secret + 16) ^ readLE64(Secret + 24);
+        const uint64_t keyed = input64 ^ bitflip;
+
+        u128 m = mult64to128(keyed, Prime64_1 + (uint64_t(len) << 2));
+
+        m.high += m.low << 1;
+        m.low ^= m.high >> 3;
+        m.low = xorshift64(m.low, 35);
+        m.low *= PrimeMx2;
+        m.low = xorshift64(m.low, 28);
+        m.high = xxh3Avalanche(m.high);
+
+        return m;
+    }
+
+    u128 len9to16(const uint8_t* input, std::size_t len)
+    {
+        const uint64_t bitflipl = readLE64(Secret + 32) ^ readLE64(Secret + 40);
+        const uint64_t bitfliph = readLE64(Secret + 48) ^ readLE64(Secret + 56);
+        const uint64_t inputLo = readLE64(input);
+        uint64_t inputHi = readLE64(input + len - 8);
+
+        u128 m = mult64to128(inputLo ^ inputHi ^ bitflipl, Prime64_1);
+
+        m.low += uint64_t(len - 1) << 54;
+        inputHi ^= bitfliph;
+        m.high += inputHi + uint64_t(uint32_t(inputHi)) * (Prime32_2 - 1);
+        m.low ^= __builtin_bswap64(m.high);
+
+        u128 h = mult64to128(m.low, Prime64_2);
+
+        h.high += m.high * Prime64_2;
+        h.low = xxh3Avalanche(h.low);
+        h.high = xxh3Avalanche(h.high);
+
+        return h;
+    }
+
+    inline uint64_t mix16B(const uint8_t* input, const uint8_t* secret, uint64_t seed)
+    {
+        return mul128fold64(readLE64(input) ^ (readLE64(secret) + seed),
+                            readLE64(input + 8) ^ (readLE64(secret + 8) - seed));
+    }
+
+    inline void mix32B(u128& acc, const uint8_t* input1, const uint8_t* input2, const uint8_t* secret, uint64_t seed)
+    {
+        acc.low += mix16B(input1, secret, seed);
+        acc.low ^= readLE64(input2) + readLE64(input2 + 8);
+        acc.high += mix16B(input2, secret + 16, seed);
+        acc.high ^= readLE64(input1) + readLE64(input1 + 8);
+    }
+
+    u128 finishMid(const u128& acc, std::size_t len)
+    {
+        u128 h;
+
+        h.low = acc.low + acc.high;
+        h.high = acc.low * Prime64_1 + acc.high * Prime64_4 + uint64_t(len) * Prime64_2;
+        h.low = xxh3Avalanche(h.low);
+        h.high = uint64_t(0) - xxh3Avalanche(h.high);
+
+        return h;
+    }
+
+    u128 len17to128(const uint8_t* input, std::size_t len)
+    {
+        u128 acc = { len * Prime64_1, 0 };
+
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) {
+                    mix32B(acc, input + 48, input + len - 64, Secret + 96, 0);
+                }
+                mix32B(acc, input + 32, input + len - 48, Secret + 64, 0);
+            }
+            mix32B(acc, input + 16, input + len - 32, Secret + 32, 0);
+        }
+        mix32B(acc, input, input + len - 16, Secret, 0);
+
+        return finishMid(acc, len);
+    }
+
+    u128 len129to240(const uint8_t* input, std::size_t len)
+    {
+        u128 acc = { len * Prime64_1, 0 };
+
+        for (std::size_t i = 32; i < 160; i += 32) {
+            mix32B(acc, input + i - 32, input + i - 16, Secret + i - 32, 0);
+        }
+
+        acc.low = xxh3Avalanche(acc.low);
+        acc.high = xxh3Avalanche(acc.high);
+
+        for (std::size_t i = 160; i <= len; i += 32) {
+            mix32B(acc, input + i - 32, input + i - 16, Secret + MidSizeStart + i - 160, 0);
+        }
+
+        mix32B(acc, input + len - 16, input + len - 32, Secret + SecretSizeMin - MidSizeLast - 16, 0);
+
+        return finishMid(acc, len);
+    }
+
+    u128 hashShort(const uint8_t* input, std::size_t len)
+    {
+        if (len == 0) {
+            return { xxh64Avalanche(readLE64(Secret + 64) ^ readLE64(Secret + 72)),
+                     xxh64Avalanche(readLE64(Secret + 80) ^ readLE64(Secret + 88)) };
+        }
+        else if (len <= 3)   return len1to3(input, len);
+        else if (len <= 8)   return len4to8(input, len);
+        else if (len <= 16)  return len9to16(input, len);
+        else if (len <= 128) return len17to128(input, len);
+        else                 return len129to240(input, len);
+    }
+
+    // long inputs
+
+    inline void accumulate512(uint64_t acc[8], const uint8_t* input, const uint8_t* secret)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            const uint64_t dataVal = readLE64(input + 8*i);
+            const uint64_t dataKey = dataVal ^ readLE64(secret + 8*i);
+
+            acc[i ^ 1] += dataVal;
+            acc[i] += uint64_t(uint32_t(dataKey)) * (dataKey >> 32);
+        }
+    }
+
+    inline void scramble(uint64_t acc[8], const uint8_t* secret)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            uint64_t a = acc[i];
+
+            a = xorshift64(a, 47);
+            a ^= readLE64(secret + 8*i);
+            a *= Prime32_1;
+
+            acc[i] = a;
+        }
+    }
+
+    void accumulate(uint64_t acc[8], const uint8_t* input, const uint8_t* secret, std::size_t stripes)
+    {
+        for (std::size_t n = 0; n < stripes; ++n) {
+            accumulate512(acc, input + n * StripeLen, secret + n * SecretConsumeRate);
+        }
+    }
+
+    void consumeStripes(uint64_t acc[8], std::size_t& stripesSoFar, const uint8_t* input, std::size_t stripes)
+    {
+        if (StripesPerBlock - stripesSoFar <= stripes)
+        {
+            const std::size_t toEnd = StripesPerBlock - stripesSoFar;
+            const std::size_t after = stripes - toEnd;
+
+            accumulate(acc, input, Secret + stripesSoFar * SecretConsumeRate, toEnd);
+            scramble(acc, Secret + SecretLimit);
+            accumulate(acc, input + toEnd * StripeLen, Secret, after);
+
+            stripesSoFar = after;
+        }
+        else {
+            accumulate(acc, input, Secret + stripesSoFar * SecretConsumeRate, stripes);
+            stripesSoFar += stripes;
+        }
+    }
+
+    inline uint64_t mergeAccs(const uint64_t acc[8], const uint8_t* secret, uint64_t start)
+    {
+        uint64_t result = start;
+
+        for (int i = 0; i < 4; ++i) {
+            result += mul128fold64(acc[2*i] ^ readLE64(secret + 16*i),
+                                   acc[2*i + 1] ^ readLE64(secret + 16*i + 8));
+        }
+
+        return xxh3Avalanche(result);
+    }
+
+    inline void storeBE64(uint8_t* p, uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i) {
+            p[i] = uint8_t(v >> (56 - 8*i));
+        }
+    }
+}
+
+// ------------------------------------------------------------
+
+utils::Xxh3_128::Xxh3_128()
+    : m_acc{ Prime32_3, Prime64_1, Prime64_2, Prime64_3, Prime64_4, Prime32_2, Prime64_5, Prime32_1 }
+{
+}
+
+void utils::Xxh3_128::update(const void* data, std::size_t size)
+{
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    const uint8_t* const end = input + size;
+
+    m_length += size;
+
+    // the last bytes always stay buffered, because the final stripe is
+    // handled differently
+
+    if (m_buffered + size <= BufferSize)
+    {
+        memcpy(m_buffer + m_buffered, input, size);
+        m_buffered += size;
+        return;
+    }
+
+    if (m_buffered > 0)
+    {
+        const std::size_t load = BufferSize - m_buffered;
+
+        memcpy(m_buffer + m_buffered, input, load);
+        input += load;
+
+        consumeStripes(m_acc, m_stripesSoFar, m_buffer, BufferSize / StripeLen);
+        m_buffered = 0;
+    }
+
+    if (input + BufferSize < end)
+    {
+        do {
+            consumeStripes(m_acc, m_stripesSoFar, input, BufferSize / StripeLen);
+            input += BufferSize;
+        } while (input + BufferSize < end);
+
+        memcpy(m_buffer + BufferSize - StripeLen, input - StripeLen, StripeLen);
+    }
+
+    memcpy(m_buffer, input, end - input);
+    m_buffered = end - input;
+}
+
+void utils::Xxh3_128::final(uint8_t digest[DigestSize])
+{
+    u128 h;
+
+    if (m_length > MidSizeMax)
+    {
+        uint64_t acc[8];
+        std::size_t stripesSoFar = m_stripesSoFar;
+        uint8_t lastStripe[StripeLen];
+        const uint8_t* lastStripePtr;
+
+        memcpy(acc, m_acc, sizeof(acc));
+
+        if (m_buffered >= StripeLen)
+        {
+            consumeStripes(acc, stripesSoFar, m_buffer, (m_buffered - 1) / StripeLen);
+            lastStripePtr = m_buffer + m_buffered - StripeLen;
+        }
+        else {
+            const std::size_t catchup = StripeLen - m_buffered;
+
+            memcpy(lastStripe, m_buffer + BufferSize - catchup, catchup);
+            memcpy(lastStripe + catchup, m_buffer, m_buffered);
+            lastStripePtr = lastStripe;
+        }
+
+        accumulate512(acc, lastStripePtr, Secret + SecretLimit - LastAccStart);
+
+        h.low  = mergeAccs(acc, Secret + MergeAccsStart, m_length * Prime64_1);
+        h.high = mergeAccs(acc, Secret + SecretSize - sizeof(acc) - MergeAccsStart, ~(m_length * Prime64_2));
+    }
+    else {
+        h = hashShort(m_buffer, m_buffered);
+    }
+
+    storeBE64(digest,     h.high);
+    storeBE64(digest + 8, h.low);
+}
+
+std::string utils::Xxh3_128::hexdigest()
+{
+    uint8_t digest[DigestSize];
+
+    final(digest);
+
+    return toHex(digest, DigestSize);
+}
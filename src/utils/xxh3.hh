@@ -0,0 +1,44 @@
+/* swd - Scripts with Dependencies
+ * Copyright (C) 2020 Pauli Saksa
+ *
+ * Licensed under The MIT License, see file LICENSE.txt in this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace utils
+{
+    // Incremental XXH3-128 (seed 0, default secret). Non-cryptographic;
+    // the digest is printed in the canonical big-endian form.
+
+    class Xxh3_128 {
+    public:
+        enum {
+            DigestSize = 16,
+        };
+
+        //
+
+        Xxh3_128();
+
+        void update(const void* data, std::size_t size);
+        void final(uint8_t digest[DigestSize]);
+
+        std::string hexdigest();
+
+    private:
+        enum {
+            BufferSize = 256,
+        };
+
+        uint64_t m_acc[8];
+        uint8_t m_buffer[BufferSize];
+        std::size_t m_buffered = 0;
+        std::size_t m_stripesSoFar = 0;
+        uint64_t m_length = 0;
+    };
+}
@@ -0,0 +1,37 @@
+#!/usr/bin/env python3
+#
+# Reference hash_bin for "hash_bin_mode coprocess": swd starts this once and
+# sends every input over stdin as
+#
+#     "<length>\n" <length bytes>     repeated, length > 0
+#     "0\n"                           end of input
+#
+# and reads one "<hash>\n" line per input from stdout.
+
+import hashlib
+import sys
+
+def main():
+    stdin = sys.stdin.buffer
+    stdout = sys.stdout
+
+    digest = hashlib.sha256()
+
+    for header in iter(stdin.readline, b''):
+        length = int(header)
+
+        if length == 0:
+            stdout.write(digest.hexdigest() + '\n')
+            stdout.flush()
+            digest = hashlib.sha256()
+            continue
+
+        data = stdin.read(length)
+
+        if len(data) != length:
+            sys.exit("hash_coproc: truncated input")
+
+        digest.update(data)
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,29 @@
+#!/bin/bash
+# usage: tr_zygote.sh <script> <fd>
+#
+# Step worker for swd's step_zygote mode. Loads <script> once the way
+# tr_exec.sh does, then runs the steps named on stdin, one per line, each
+# in a subshell with its output to <fd>, and reports each exit status on
+# stdout.
+
+if [ ! "$TR" ]
+then
+    echo "\$TR needs to be defined." >&2
+    exit 1
+fi
+
+#####
+
+script="$1"
+out="$2"
+
+set -- "$script"
+. "$script" </dev/null >&"$out"
+
+echo "swd-zygote 1"
+
+while read -r step
+do
+    ( set -- "$script" "$step" ; "$step" ) </dev/null >&"$out"
+    echo "$?"
+done